@@ -98,6 +98,12 @@ uint32_t open(uint32_t* filename, uint32_t flags, uint32_t mode);
 // selfie bootstraps void* and unsigned long to uint32_t* and uint32_t, respectively!
 void* malloc(unsigned long);
 
+// selfie bootstraps void* to uint32_t*!
+void* mmap(uint32_t* addr, uint32_t length, uint32_t prot, uint32_t flags, uint32_t fd, uint32_t offset);
+
+uint32_t lseek(uint32_t fd, uint32_t offset, uint32_t whence);
+uint32_t unlink(uint32_t* path);
+
 // -----------------------------------------------------------------
 // ----------------------- LIBRARY PROCEDURES ----------------------
 // -----------------------------------------------------------------
@@ -234,6 +240,34 @@ uint32_t WINDOWS_O_BINARY_CREAT_TRUNC_WRONLY = 33537;
 // these flags seem to be working for LINUX, MAC, and WINDOWS
 uint32_t S_IRUSR_IWUSR_IRGRP_IROTH = 420;
 
+// flags for opening read-write files
+// MAC: 1538 = 0x0602 = O_CREAT (0x0200) | O_TRUNC (0x0400) | O_RDWR (0x0002)
+uint32_t MAC_O_CREAT_TRUNC_RDWR = 1538;
+
+// LINUX: 578 = 0x0242 = O_CREAT (0x0040) | O_TRUNC (0x0200) | O_RDWR (0x0002)
+uint32_t LINUX_O_CREAT_TRUNC_RDWR = 578;
+
+// WINDOWS: 33538 = 0x8302 = _O_BINARY (0x8000) | _O_CREAT (0x0100) | _O_TRUNC (0x0200) | _O_RDWR (0x0002)
+uint32_t WINDOWS_O_BINARY_CREAT_TRUNC_RDWR = 33538;
+
+// seeking file offsets relative to the beginning of files
+uint32_t SEEK_SET = 0;
+
+// flags for mapping memory
+// 3 = 0x03 = PROT_READ (0x01) | PROT_WRITE (0x02)
+uint32_t PROT_READ_WRITE = 3;
+
+// LINUX and MAC: 2 = 0x0002 = MAP_PRIVATE (0x0002)
+uint32_t MAP_PRIVATE = 2;
+
+// LINUX: 34 = 0x0022 = MAP_PRIVATE (0x0002) | MAP_ANONYMOUS (0x0020)
+uint32_t LINUX_MAP_PRIVATE_ANONYMOUS = 34;
+
+// MAC: 4098 = 0x1002 = MAP_PRIVATE (0x0002) | MAP_ANON (0x1000)
+uint32_t MAC_MAP_PRIVATE_ANONYMOUS = 4098;
+
+uint32_t MAP_FAILED = -1;
+
 // ------------------------ GLOBAL VARIABLES -----------------------
 
 uint32_t number_of_written_characters = 0;
@@ -874,6 +908,7 @@ uint32_t* create_elf_header(uint32_t binary_length, uint32_t code_length);
 uint32_t  validate_elf_header(uint32_t* header);
 
 uint32_t open_write_only(uint32_t* name);
+uint32_t open_read_write(uint32_t* name);
 
 void selfie_output();
 
@@ -883,10 +918,10 @@ void selfie_load();
 
 // ------------------------ GLOBAL CONSTANTS -----------------------
 
-uint32_t MAX_BINARY_LENGTH = 262144; // 256KB = MAX_CODE_LENGTH + MAX_DATA_LENGTH
+uint32_t MAX_BINARY_LENGTH = 278528; // 272KB = MAX_CODE_LENGTH + MAX_DATA_LENGTH
 
 uint32_t MAX_CODE_LENGTH = 245760; // 240KB
-uint32_t MAX_DATA_LENGTH = 16384; // 16KB
+uint32_t MAX_DATA_LENGTH = 32768; // 32KB
 
 // page-aligned ELF header for storing file header (52 bytes),
 // program header (32 bytes), and code length (4 bytes)
@@ -949,6 +984,16 @@ void     implement_openat(uint32_t* context);
 void emit_malloc();
 void implement_brk(uint32_t* context);
 
+void emit_mmap();
+void emit_lseek();
+void emit_unlink();
+
+void emit_fork();
+void implement_fork(uint32_t* context);
+
+void emit_wait();
+void implement_wait(uint32_t* context);
+
 // ------------------------ GLOBAL CONSTANTS -----------------------
 
 uint32_t debug_read  = 0;
@@ -961,6 +1006,8 @@ uint32_t SYSCALL_READ   = 63;
 uint32_t SYSCALL_WRITE  = 64;
 uint32_t SYSCALL_OPENAT = 56;
 uint32_t SYSCALL_BRK    = 214;
+uint32_t SYSCALL_FORK   = 220; // clone without arguments
+uint32_t SYSCALL_WAIT   = 260; // wait4 with wstatus as only argument
 
 /* DIRFD_AT_FDCWD corresponds to AT_FDCWD in fcntl.h and
    is passed as first argument of the openat system call
@@ -999,9 +1046,13 @@ void init_memory(uint32_t megabytes);
 uint32_t load_physical_memory(uint32_t* paddr);
 void     store_physical_memory(uint32_t* paddr, uint32_t data);
 
-uint32_t frame_for_page(uint32_t* table, uint32_t page);
-uint32_t get_frame_for_page(uint32_t* table, uint32_t page);
-uint32_t is_page_mapped(uint32_t* table, uint32_t page);
+uint32_t* allocate_page_table();
+uint32_t  get_frame_for_page(uint32_t* table, uint32_t page);
+void      set_frame_for_page(uint32_t* table, uint32_t page, uint32_t frame);
+void      unmap_page(uint32_t* table, uint32_t page);
+uint32_t  is_page_mapped(uint32_t* table, uint32_t page);
+uint32_t  is_page_read_only(uint32_t* table, uint32_t page);
+void      write_protect_page(uint32_t* table, uint32_t page);
 
 uint32_t is_valid_virtual_address(uint32_t vaddr);
 uint32_t get_page_of_virtual_address(uint32_t vaddr);
@@ -1009,9 +1060,18 @@ uint32_t is_virtual_address_mapped(uint32_t* table, uint32_t vaddr);
 
 uint32_t* tlb(uint32_t* table, uint32_t vaddr);
 
+void      flush_tlb(uint32_t* cache);
+void      flush_tlb_entry(uint32_t* cache, uint32_t page);
+uint32_t  is_page_cached(uint32_t* cache, uint32_t page);
+uint32_t* lookup_tlb(uint32_t* cache, uint32_t* table, uint32_t vaddr);
+uint32_t* lookup_writable_tlb(uint32_t* cache, uint32_t* table, uint32_t vaddr);
+
 uint32_t load_virtual_memory(uint32_t* table, uint32_t vaddr);
 void     store_virtual_memory(uint32_t* table, uint32_t vaddr, uint32_t data);
 
+void load_virtual_words(uint32_t* table, uint32_t vaddr, uint32_t* data, uint32_t bytes);
+void store_virtual_words(uint32_t* table, uint32_t vaddr, uint32_t* data, uint32_t bytes);
+
 // ------------------------ GLOBAL CONSTANTS -----------------------
 
 uint32_t debug_tlb = 0;
@@ -1028,10 +1088,31 @@ uint32_t REGISTERSIZE    = 4; // must be the same as WORDSIZE
 
 uint32_t PAGESIZE = 4096; // we use standard 4KB pages
 
+// software tlb entry struct:
+// +---+-----------+
+// | 0 | tag       | page + 1 of cached translation, 0 if empty
+// | 1 | frame     | frame mapped to page
+// | 2 | write tag | page + 1 if page is writable, 0 otherwise
+// +---+-----------+
+
+// two-level page tables: a root table of pointers to leaf tables,
+// leaf tables of frames are only allocated when mapping their pages
+
+uint32_t LEAFTABLEPAGES = 1024; // number of pages mapped by a leaf table
+
+// page-aligned frames of read-only pages are marked in leaf tables
+uint32_t READONLY = 1;
+
+uint32_t TLBENTRYSIZE = 3;  // in words
+uint32_t TLBENTRIES   = 64; // number of direct-mapped tlb entries
+
 // ------------------------ GLOBAL VARIABLES -----------------------
 
 uint32_t page_frame_memory = 0; // size of memory for frames
 
+uint32_t tlb_hits   = 0; // number of translations found in software tlb
+uint32_t tlb_misses = 0; // number of translations not found in software tlb
+
 // ------------------------- INITIALIZATION ------------------------
 
 void init_memory(uint32_t megabytes) {
@@ -1119,7 +1200,9 @@ void do_jalr();
 
 void print_ecall();
 void record_ecall();
+uint32_t is_inline_system_call();
 void do_ecall();
+void execute_ecall();
 void undo_ecall();
 void backtrack_ecall();
 
@@ -1282,9 +1365,46 @@ void print_exception(uint32_t exception, uint32_t faulting_page);
 void throw_exception(uint32_t exception, uint32_t faulting_page);
 
 void fetch();
+void decode();
+void execute_instruction();
 void decode_execute();
+
+uint32_t  decode_handler();
+uint32_t* decoded_instruction(uint32_t* cache, uint32_t length, uint32_t vaddr);
+void      invalidate_decoded_instructions(uint32_t* context, uint32_t vaddr, uint32_t bytes);
+uint32_t  fetch_decode();
+void      execute_handler(uint32_t handler);
+void      execute_counted_handler(uint32_t handler);
+void      execute_uncounted_handler(uint32_t handler);
+
+void     fuse_decoded_instructions(uint32_t* entry, uint32_t vaddr);
+uint32_t superinstruction_length(uint32_t handler);
+void     load_next_instruction();
+void     execute_superinstruction(uint32_t handler);
+void     execute_counted_superinstruction(uint32_t handler);
+void     execute_uncounted_superinstruction(uint32_t handler);
+
+uint32_t  is_control_transfer(uint32_t handler);
+void      translate_hot_code(uint32_t from);
+void      count_hot_code();
+uint32_t  execute_block(uint32_t* entry);
+uint32_t  execute_counted_block(uint32_t* entry);
+uint32_t  execute_uncounted_block(uint32_t* entry);
+
 void interrupt();
 
+void run_basic_blocks();
+void run_counted_basic_blocks();
+void run_uncounted_basic_blocks();
+
+void run_fast_engine();
+void run_counted_fast_engine();
+void run_uncounted_fast_engine();
+
+void run_block_engine();
+void run_counted_block_engine();
+void run_uncounted_block_engine();
+
 uint32_t* run_until_exception();
 
 uint32_t instruction_with_max_counter(uint32_t* counters, uint32_t max);
@@ -1305,6 +1425,7 @@ uint32_t EXCEPTION_INVALIDADDRESS     = 4;
 uint32_t EXCEPTION_DIVISIONBYZERO     = 5;
 uint32_t EXCEPTION_UNKNOWNINSTRUCTION = 6;
 uint32_t EXCEPTION_MAXTRACE           = 7;
+uint32_t EXCEPTION_WRITEFAULT         = 8;
 
 uint32_t* EXCEPTIONS; // strings representing exceptions
 
@@ -1323,6 +1444,8 @@ uint32_t backtrack   = 0; // flag for backtracking symbolic execution
 
 uint32_t disassemble_verbose = 0; // flag for disassembling code in more detail
 
+uint32_t jit = 0; // flag for translating and executing hot blocks
+
 // number of instructions from context switch to timer interrupt
 // CAUTION: avoid interrupting any kernel activities, keep TIMESLICE large
 // TODO: implement proper interrupt controller to turn interrupts on and off
@@ -1330,6 +1453,60 @@ uint32_t TIMESLICE = 10000000;
 
 uint32_t TIMEROFF = 0;
 
+// decoded instruction struct:
+// +---+---------+
+// | 0 | handler | handler of instruction, HANDLER_NONE if not decoded yet
+// | 1 | rs1     | first source register
+// | 2 | rs2     | second source register
+// | 3 | rd      | destination register
+// | 4 | imm     | sign-extended immediate
+// | 5 | block   | number of instructions in translated block starting here, 0 if none
+// | 6 | heat    | number of loop iterations or procedure calls starting here
+// | 7 | fused   | handler of superinstruction starting here, HANDLER_NONE if none
+// +---+---------+
+
+uint32_t DECODEDINSTRUCTIONSIZE = 8; // in words
+
+// number of loop iterations or procedure calls before translation into blocks
+uint32_t HOTCODE = 64;
+
+// handlers of decoded instructions, handlers of straight-line
+// instructions which never change control flow come first
+uint32_t HANDLER_NONE    = 0;
+uint32_t HANDLER_ADDI    = 1;
+uint32_t HANDLER_LW      = 2;
+uint32_t HANDLER_SW      = 3;
+uint32_t HANDLER_MUL     = 4;
+uint32_t HANDLER_ADD     = 5;
+uint32_t HANDLER_SUB     = 6;
+uint32_t HANDLER_SLTU    = 7;
+uint32_t HANDLER_DIVU    = 8;
+uint32_t HANDLER_REMU    = 9;
+uint32_t HANDLER_LUI     = 10;
+uint32_t HANDLER_UNKNOWN = 11;
+uint32_t HANDLER_JAL     = 12;
+uint32_t HANDLER_JALR    = 13;
+uint32_t HANDLER_BEQ     = 14;
+uint32_t HANDLER_ECALL   = 15;
+
+// handlers of superinstructions fusing idioms of starc
+uint32_t HANDLER_PUSH      = 16; // addi $sp,$sp,-4 and sw rs2,0($sp)
+uint32_t HANDLER_POP       = 17; // lw rd,0($sp) and addi $sp,$sp,4
+uint32_t HANDLER_LI        = 18; // lui rd,imm and addi rd,rd,imm
+uint32_t HANDLER_SLTU_BEQ  = 19; // sltu rd,rs1,rs2 and beq rd,$zero,imm
+uint32_t HANDLER_EQUAL_BEQ = 20; // sub, addi, and sltu of == and beq
+
+uint32_t MAX_SUPERINSTRUCTION_LENGTH = 4; // in instructions
+
+// upper bound on number of instructions in a basic block
+// including a superinstruction at its end
+uint32_t MAX_BLOCK_LENGTH;
+
+// profiling levels
+uint32_t PROFILE_NONE      = 0; // no profile
+uint32_t PROFILE_AGGREGATE = 1; // instruction counters only
+uint32_t PROFILE_FULL      = 2; // plus per-instruction counters
+
 // ------------------------ GLOBAL VARIABLES -----------------------
 
 // hardware thread state
@@ -1341,8 +1518,20 @@ uint32_t* registers = (uint32_t*) 0; // general-purpose registers
 
 uint32_t* pt = (uint32_t*) 0; // page table
 
+uint32_t* dcache = (uint32_t*) 0; // decoded instruction cache
+
+uint32_t dcache_length = 0; // number of code bytes covered by dcache
+
+uint32_t* stlb = (uint32_t*) 0; // software tlb
+
+// profiling level of fast and block engines
+
+uint32_t profiling = 0;
+
 // core state
 
+uint32_t timeslice = 0; // configurable time slice
+
 uint32_t timer = 0; // counter for timer interrupt
 uint32_t trap  = 0; // flag for creating a trap
 
@@ -1360,7 +1549,13 @@ uint32_t* stores_per_instruction = (uint32_t*) 0; // number of executed stores p
 // ------------------------- INITIALIZATION ------------------------
 
 void init_interpreter() {
-  EXCEPTIONS = smalloc((EXCEPTION_MAXTRACE + 1) * SIZEOFUINT32STAR);
+  MAX_BLOCK_LENGTH = MAX_CODE_LENGTH / INSTRUCTIONSIZE + MAX_SUPERINSTRUCTION_LENGTH;
+
+  profiling = PROFILE_FULL;
+
+  timeslice = TIMESLICE;
+
+  EXCEPTIONS = smalloc((EXCEPTION_WRITEFAULT + 1) * SIZEOFUINT32STAR);
 
   *(EXCEPTIONS + EXCEPTION_NOEXCEPTION)        = (uint32_t) "no exception";
   *(EXCEPTIONS + EXCEPTION_PAGEFAULT)          = (uint32_t) "page fault";
@@ -1370,6 +1565,7 @@ void init_interpreter() {
   *(EXCEPTIONS + EXCEPTION_DIVISIONBYZERO)     = (uint32_t) "division by zero";
   *(EXCEPTIONS + EXCEPTION_UNKNOWNINSTRUCTION) = (uint32_t) "unknown instruction";
   *(EXCEPTIONS + EXCEPTION_MAXTRACE)           = (uint32_t) "trace length exceeded";
+  *(EXCEPTIONS + EXCEPTION_WRITEFAULT)         = (uint32_t) "write fault";
 }
 
 void reset_interpreter() {
@@ -1380,6 +1576,15 @@ void reset_interpreter() {
 
   pt = (uint32_t*) 0;
 
+  dcache = (uint32_t*) 0;
+
+  dcache_length = 0;
+
+  stlb = (uint32_t*) 0;
+
+  tlb_hits   = 0;
+  tlb_misses = 0;
+
   trap = 0;
 
   timer = TIMEROFF;
@@ -1398,14 +1603,49 @@ void reset_interpreter() {
   }
 }
 
+// -----------------------------------------------------------------
+// -------------------------- TRANSLATOR ---------------------------
+// -----------------------------------------------------------------
+
+void find_leaders();
+
+void translate_runtime();
+void translate_system_calls();
+void translate_main();
+
+void     translate_jump(uint32_t target, uint32_t from, uint32_t to);
+void     translate_instruction(uint32_t from, uint32_t to);
+uint32_t next_procedure(uint32_t from);
+void     translate_procedures();
+
+void selfie_translate();
+
+// ------------------------ GLOBAL CONSTANTS -----------------------
+
+uint32_t LEADER_PROCEDURE = 1; // target of jal with link
+
+// ------------------------ GLOBAL VARIABLES -----------------------
+
+uint32_t* translation_name = (uint32_t*) 0; // name of C file
+uint32_t  translation_fd   = 0; // file descriptor of open C file
+
+uint32_t* leaders = (uint32_t*) 0; // leader status of each instruction
+uint32_t* labels  = (uint32_t*) 0; // 1 if instruction is target of beq or jal without link
+
+uint32_t number_of_translated_procedures = 0;
+
 // -----------------------------------------------------------------
 // ---------------------------- CONTEXTS ---------------------------
 // -----------------------------------------------------------------
 
 uint32_t* allocate_context(uint32_t* parent, uint32_t* vctxt, uint32_t* in);
 
-uint32_t* find_context(uint32_t* parent, uint32_t* vctxt, uint32_t* in);
+uint32_t  hash_context(uint32_t* parent, uint32_t* vctxt);
+void      index_context(uint32_t* context);
+void      unindex_context(uint32_t* context);
+uint32_t* find_context(uint32_t* parent, uint32_t* vctxt);
 
+void      clear_context(uint32_t* context);
 void      free_context(uint32_t* context);
 uint32_t* delete_context(uint32_t* context, uint32_t* from);
 
@@ -1427,6 +1667,20 @@ uint32_t* delete_context(uint32_t* context, uint32_t* from);
 // | 13 | parent          | context that created this context
 // | 14 | virtual context | virtual context address
 // | 15 | name            | binary name loaded into context
+// | 16 | decode cache    | pointer to decoded instruction cache
+// | 17 | software tlb    | pointer to software tlb
+// | 18 | next ready      | pointer to next context in ready queue
+// | 19 | state           | scheduling state
+// | 20 | next hashed     | pointer to next context in hash bucket
+// | 21 | pid             | process ID
+// | 22 | forker          | context that forked this context, if any
+// | 23 | dirty log       | pointer to pages remapped since last restore
+// | 24 | dirty pages     | number of remapped pages, more than logged if log overflowed
+// | 25 | paravirtual     | 1 if read and write calls are forwarded unchanged
+// | 26 | hosting         | 1 if context has hosted other contexts
+// | 27 | decode length   | number of code bytes covered by decode cache
+// | 28 | children        | pointer to most recently forked child not yet reaped
+// | 29 | next sibling    | pointer to next child of forker
 // +----+-----------------+
 
 uint32_t next_context(uint32_t* context)    { return (uint32_t) context; }
@@ -1445,6 +1699,16 @@ uint32_t exit_code(uint32_t* context)       { return (uint32_t) (context + 12);
 uint32_t parent(uint32_t* context)          { return (uint32_t) (context + 13); }
 uint32_t virtual_context(uint32_t* context) { return (uint32_t) (context + 14); }
 uint32_t name(uint32_t* context)            { return (uint32_t) (context + 15); }
+uint32_t decode_cache(uint32_t* context)    { return (uint32_t) (context + 16); }
+uint32_t software_tlb(uint32_t* context)    { return (uint32_t) (context + 17); }
+uint32_t next_ready(uint32_t* context)      { return (uint32_t) (context + 18); }
+uint32_t state(uint32_t* context)           { return (uint32_t) (context + 19); }
+uint32_t next_hashed(uint32_t* context)     { return (uint32_t) (context + 20); }
+uint32_t pid(uint32_t* context)             { return (uint32_t) (context + 21); }
+uint32_t forker(uint32_t* context)          { return (uint32_t) (context + 22); }
+uint32_t dirty_log(uint32_t* context)       { return (uint32_t) (context + 23); }
+uint32_t dirty_pages(uint32_t* context)     { return (uint32_t) (context + 24); }
+uint32_t paravirtual(uint32_t* context)     { return (uint32_t) (context + 25); }
 
 uint32_t* get_next_context(uint32_t* context)    { return (uint32_t*) *context; }
 uint32_t* get_prev_context(uint32_t* context)    { return (uint32_t*) *(context + 1); }
@@ -1462,6 +1726,20 @@ uint32_t  get_exit_code(uint32_t* context)       { return             *(context
 uint32_t* get_parent(uint32_t* context)          { return (uint32_t*) *(context + 13); }
 uint32_t* get_virtual_context(uint32_t* context) { return (uint32_t*) *(context + 14); }
 uint32_t* get_name(uint32_t* context)            { return (uint32_t*) *(context + 15); }
+uint32_t* get_decode_cache(uint32_t* context)    { return (uint32_t*) *(context + 16); }
+uint32_t* get_software_tlb(uint32_t* context)    { return (uint32_t*) *(context + 17); }
+uint32_t* get_next_ready(uint32_t* context)      { return (uint32_t*) *(context + 18); }
+uint32_t  get_state(uint32_t* context)           { return             *(context + 19); }
+uint32_t* get_next_hashed(uint32_t* context)     { return (uint32_t*) *(context + 20); }
+uint32_t  get_pid(uint32_t* context)             { return             *(context + 21); }
+uint32_t* get_forker(uint32_t* context)          { return (uint32_t*) *(context + 22); }
+uint32_t* get_dirty_log(uint32_t* context)       { return (uint32_t*) *(context + 23); }
+uint32_t  get_dirty_pages(uint32_t* context)     { return             *(context + 24); }
+uint32_t  get_paravirtual(uint32_t* context)     { return             *(context + 25); }
+uint32_t  get_hosting(uint32_t* context)         { return             *(context + 26); }
+uint32_t  get_decode_length(uint32_t* context)   { return             *(context + 27); }
+uint32_t* get_children(uint32_t* context)        { return (uint32_t*) *(context + 28); }
+uint32_t* get_next_sibling(uint32_t* context)    { return (uint32_t*) *(context + 29); }
 
 void set_next_context(uint32_t* context, uint32_t* next)     { *context        = (uint32_t) next; }
 void set_prev_context(uint32_t* context, uint32_t* prev)     { *(context + 1)  = (uint32_t) prev; }
@@ -1479,6 +1757,20 @@ void set_exit_code(uint32_t* context, uint32_t code)         { *(context + 12) =
 void set_parent(uint32_t* context, uint32_t* parent)         { *(context + 13) = (uint32_t) parent; }
 void set_virtual_context(uint32_t* context, uint32_t* vctxt) { *(context + 14) = (uint32_t) vctxt; }
 void set_name(uint32_t* context, uint32_t* name)             { *(context + 15) = (uint32_t) name; }
+void set_decode_cache(uint32_t* context, uint32_t* cache)    { *(context + 16) = (uint32_t) cache; }
+void set_software_tlb(uint32_t* context, uint32_t* cache)    { *(context + 17) = (uint32_t) cache; }
+void set_next_ready(uint32_t* context, uint32_t* next)       { *(context + 18) = (uint32_t) next; }
+void set_state(uint32_t* context, uint32_t state)            { *(context + 19) = state; }
+void set_next_hashed(uint32_t* context, uint32_t* next)      { *(context + 20) = (uint32_t) next; }
+void set_pid(uint32_t* context, uint32_t pid)                { *(context + 21) = pid; }
+void set_forker(uint32_t* context, uint32_t* forker)         { *(context + 22) = (uint32_t) forker; }
+void set_dirty_log(uint32_t* context, uint32_t* log)         { *(context + 23) = (uint32_t) log; }
+void set_dirty_pages(uint32_t* context, uint32_t pages)      { *(context + 24) = pages; }
+void set_paravirtual(uint32_t* context, uint32_t forwards)   { *(context + 25) = forwards; }
+void set_hosting(uint32_t* context, uint32_t hosting)        { *(context + 26) = hosting; }
+void set_decode_length(uint32_t* context, uint32_t length)   { *(context + 27) = length; }
+void set_children(uint32_t* context, uint32_t* child)        { *(context + 28) = (uint32_t) child; }
+void set_next_sibling(uint32_t* context, uint32_t* next)     { *(context + 29) = (uint32_t) next; }
 
 // -----------------------------------------------------------------
 // -------------------------- MICROKERNEL --------------------------
@@ -1490,17 +1782,34 @@ uint32_t* create_context(uint32_t* parent, uint32_t* vctxt);
 
 uint32_t* cache_context(uint32_t* vctxt);
 
+void      make_ready(uint32_t* context);
+void      block_context(uint32_t* context);
+void      unblock_context(uint32_t* context);
+uint32_t* schedule(uint32_t* from_context);
+uint32_t  time_slice();
+
 void save_context(uint32_t* context);
 
 void map_page(uint32_t* context, uint32_t page, uint32_t frame);
 
-void restore_context(uint32_t* context);
+uint32_t load_frame_for_page(uint32_t* parent_table, uint32_t* table, uint32_t page);
+void     map_hosted_page(uint32_t* context, uint32_t* parent_table, uint32_t page, uint32_t frame);
+void     restore_context(uint32_t* context);
 
 // ------------------------ GLOBAL CONSTANTS -----------------------
 
 uint32_t debug_create = 0;
 uint32_t debug_map    = 0;
 
+uint32_t CONTEXTBUCKETS = 64; // number of buckets in context index
+
+uint32_t DIRTYPAGES = 16; // number of remapped pages logged per context
+
+// scheduling states of contexts
+uint32_t STATE_RUNNABLE = 0; // running or in ready queue
+uint32_t STATE_BLOCKED  = 1; // waiting for an event such as I/O
+uint32_t STATE_EXITED   = 2; // done but not yet deleted
+
 // ------------------------ GLOBAL VARIABLES -----------------------
 
 uint32_t* current_context = (uint32_t*) 0; // context currently running
@@ -1508,11 +1817,42 @@ uint32_t* current_context = (uint32_t*) 0; // context currently running
 uint32_t* used_contexts = (uint32_t*) 0; // doubly-linked list of used contexts
 uint32_t* free_contexts = (uint32_t*) 0; // singly-linked list of free contexts
 
+// hash index of used contexts by parent and virtual context
+
+uint32_t* context_index = (uint32_t*) 0;
+
+uint32_t context_hits   = 0; // number of contexts found in index
+uint32_t context_misses = 0; // number of contexts not found in index
+
+// round-robin ready queue of contexts on my boot level
+
+uint32_t* ready_contexts     = (uint32_t*) 0; // head of ready queue
+uint32_t* last_ready_context = (uint32_t*) 0; // tail of ready queue
+
+uint32_t number_of_ready_contexts   = 0;
+uint32_t number_of_blocked_contexts = 0;
+
+uint32_t next_pid = 1; // process ID of next created context
+
 // ------------------------- INITIALIZATION ------------------------
 
 void reset_microkernel() {
   current_context = (uint32_t*) 0;
 
+  if (context_index == (uint32_t*) 0)
+    context_index = zalloc(CONTEXTBUCKETS * SIZEOFUINT32STAR);
+
+  context_hits   = 0;
+  context_misses = 0;
+
+  ready_contexts     = (uint32_t*) 0;
+  last_ready_context = (uint32_t*) 0;
+
+  number_of_ready_contexts   = 0;
+  number_of_blocked_contexts = 0;
+
+  next_pid = 1;
+
   while (used_contexts != (uint32_t*) 0)
     used_contexts = delete_context(used_contexts, used_contexts);
 }
@@ -1525,18 +1865,64 @@ uint32_t pavailable();
 uint32_t pexcess();
 uint32_t pused();
 
+uint32_t* map_page_frame_memory();
+
 uint32_t* palloc();
 void      pfree(uint32_t* frame);
 
+uint32_t* find_shared_frame(uint32_t frame);
+uint32_t  is_frame_shared(uint32_t frame);
+void      share_frame(uint32_t frame);
+uint32_t  unshare_frame(uint32_t frame);
+
+void release_page_frames(uint32_t* context);
+
+void     track_page(uint32_t* context, uint32_t page);
+void     untrack_next_page();
+void     invalidate_hosted_contexts(uint32_t* context);
+uint32_t open_swap_file();
+uint32_t hash_swapped_page(uint32_t* context, uint32_t page);
+
+uint32_t* allocate_swapped_page(uint32_t* context, uint32_t page);
+void      read_swap_slot(uint32_t slot, uint32_t* frame);
+void      write_swap_slot(uint32_t slot, uint32_t* frame);
+
+uint32_t page_out();
+uint32_t page_in(uint32_t* context, uint32_t page);
+uint32_t load_binary_page(uint32_t* context, uint32_t page);
+uint32_t demand_page(uint32_t* context, uint32_t page);
+void     page_in_context(uint32_t* context);
+void     discard_swapped_pages(uint32_t* context);
+void     duplicate_swapped_pages(uint32_t* context, uint32_t* child);
+
+void copy_on_write(uint32_t* context, uint32_t page);
+
+void adopt_child(uint32_t* context, uint32_t* child);
+
+void reap_context(uint32_t* context);
+void retire_context(uint32_t* context);
+
+void map_writable_page(uint32_t* context, uint32_t page);
 void map_and_store(uint32_t* context, uint32_t vaddr, uint32_t data);
+void up_load_words(uint32_t* context, uint32_t vaddr, uint32_t* data, uint32_t bytes);
 
+void load_code_frames();
 void up_load_binary(uint32_t* context);
 
 uint32_t up_load_string(uint32_t* context, uint32_t* s, uint32_t SP);
 void     up_load_arguments(uint32_t* context, uint32_t argc, uint32_t* argv);
 
+uint32_t  snapshot_number(uint32_t* context);
+uint32_t  save_snapshot_frame(uint32_t frame, uint32_t slot);
+uint32_t  snapshot_pages(uint32_t* context, uint32_t* entry);
+void      save_snapshot(uint32_t* context);
+uint32_t* restore_snapshot();
+
 uint32_t handle_system_call(uint32_t* context);
+uint32_t forwards_unchanged(uint32_t* context);
+uint32_t handle_paravirtual_call(uint32_t* context);
 uint32_t handle_page_fault(uint32_t* context);
+uint32_t handle_write_fault(uint32_t* context);
 uint32_t handle_division_by_zero(uint32_t* context);
 uint32_t handle_max_trace(uint32_t* context);
 uint32_t handle_timer(uint32_t* context);
@@ -1594,6 +1980,8 @@ uint32_t MOBSTER = 6;
 
 uint32_t HYPSTER = 7;
 
+uint32_t JIPSTER = 8;
+
 // ------------------------ GLOBAL VARIABLES -----------------------
 
 uint32_t next_page_frame = 0;
@@ -1601,6 +1989,145 @@ uint32_t next_page_frame = 0;
 uint32_t allocated_page_frame_memory = 0;
 uint32_t free_page_frame_memory      = 0;
 
+uint32_t* free_page_frames = (uint32_t*) 0; // singly-linked list of freed page frames
+
+uint32_t freed_page_frame_memory = 0; // memory in list of freed page frames
+uint32_t peak_page_frame_memory  = 0; // maximum of used page frame memory
+
+// copy on write of page frames shared by forked contexts
+
+// shared frame struct:
+// +---+------------+
+// | 0 | next       | pointer to next shared frame in hash bucket
+// | 1 | frame      | page frame mapped by more than one page
+// | 2 | references | number of pages mapped to frame
+// +---+------------+
+
+uint32_t SHAREDBUCKETS = 64; // number of buckets in index of shared frames
+
+uint32_t* shared_frames      = (uint32_t*) 0; // hash index of shared frames by frame
+uint32_t* free_shared_frames = (uint32_t*) 0; // singly-linked list of unused shared frame structs
+
+// demand paging with a swap file on boot level zero
+
+// resident page struct:
+// +---+---------+
+// | 0 | next    | pointer to next resident page in circular list
+// | 1 | context | context mapping page
+// | 2 | page    | mapped page
+// +---+---------+
+
+// swapped page struct:
+// +---+---------+
+// | 0 | next    | pointer to next swapped page in hash bucket
+// | 1 | context | context of swapped page
+// | 2 | page    | swapped page
+// | 3 | slot    | page-sized slot in swap file
+// +---+---------+
+
+uint32_t SWAPBUCKETS = 64; // number of buckets in index of swapped pages
+
+uint32_t* resident_pages      = (uint32_t*) 0; // clock hand: resident page before next candidate
+uint32_t* free_resident_pages = (uint32_t*) 0; // singly-linked list of unused resident page structs
+
+uint32_t number_of_resident_pages = 0;
+
+uint32_t* swapped_pages   = (uint32_t*) 0; // hash index of swapped pages by context and page
+uint32_t* free_swap_slots = (uint32_t*) 0; // singly-linked list of swapped page structs with free slots
+
+uint32_t number_of_swapped_pages = 0;
+
+uint32_t next_swap_slot = 0; // lowest never used slot in swap file
+
+uint32_t swapping = 0; // flag for swapping pages to swap file
+
+uint32_t* swap_file_name = (uint32_t*) 0; // name of swap file, selfie.swap if not set
+
+uint32_t swap_fd = 0; // file descriptor of swap file, 0 if not yet opened
+
+uint32_t page_ins  = 0; // number of pages read from swap file
+uint32_t page_outs = 0; // number of pages written to swap file
+
+uint32_t* swap_buffer = (uint32_t*) 0; // page-sized buffer for copying swap slots
+
+// full code pages of the most recently loaded binary are
+// mapped read-only to the same page frames in all contexts
+
+uint32_t* code_binary = (uint32_t*) 0; // binary loaded into code frames
+uint32_t* code_frames = (uint32_t*) 0; // page frames of full code pages
+uint32_t  code_pages  = 0;             // number of full code pages
+
+// data pages of binaries may be loaded on first access rather than
+// uploaded eagerly, using the loaded binary as backing store
+
+uint32_t demand_loading = 0; // flag for loading data pages on demand
+
+// read and write calls of hosted contexts are handled on my boot level
+// rather than by their hosting boot levels if all of them opted in to
+// forward the calls unchanged and the buffer is already mapped here
+
+uint32_t paravirtual_calls = 0; // flag for forwarding read and write calls unchanged
+
+// snapshots of all contexts on my boot level including their pages
+
+// snapshot file header:
+// +---+-------------+
+// | 0 | header size | size of header in bytes, multiple of PAGESIZE
+// | 1 | frames      | number of page frames following the header
+// | 2 | contexts    | number of context records
+// | 3 | ready       | number of contexts in ready queue
+// | 4 | running     | number of running context
+// | 5 | next pid    | process ID of next created context
+// | 6 | entry point | beginning of code segment of binary
+// | 7 | name        | length of binary name in words
+// | 8 | code length | length of code segment of binary in bytes
+// +---+-------------+
+
+// the header continues with the binary name, the context records in
+// the order of their creation, and the numbers of the contexts in the
+// ready queue; contexts are numbered from 1, 0 stands for my context
+
+// context record:
+// +----+-----------------+
+// |  0 | pid             | process ID
+// |  1 | program counter | program counter
+// |  2 | original break  | original end of data segment
+// |  3 | program break   | end of data segment
+// |  4 | exit code       | exit code
+// |  5 | parent          | number of parent context
+// |  6 | virtual context | virtual context address
+// |  7 | named           | 1 if context runs the binary, 0 otherwise
+// |  8 | state           | scheduling state
+// |  9 | forker          | number of forking context, 0 if none
+// | 10 | pages           | number of mapped and swapped pages
+// | 11 | regs            | values of general purpose registers
+// +----+-----------------+
+
+// the registers are followed by one pair of page and frame offset
+// after the header per page, marked like frames of read-only pages
+
+// saved frame struct:
+// +---+--------+
+// | 0 | next   | pointer to next saved frame in hash bucket
+// | 1 | order  | pointer to next saved frame in snapshot
+// | 2 | frame  | saved page frame, 0 if swapped out
+// | 3 | slot   | slot in swap file of swapped out page
+// | 4 | offset | offset of page frame after header
+// +---+--------+
+
+uint32_t SNAPSHOTHEADER  = 9;    // number of words in snapshot header
+uint32_t SNAPSHOTRECORD  = 11;   // number of words in context record before registers
+uint32_t SNAPSHOTBUCKETS = 1024; // number of buckets in index of saved frames
+
+uint32_t* save_snapshot_name    = (uint32_t*) 0; // snapshot saved before first read from standard input
+uint32_t* restore_snapshot_name = (uint32_t*) 0; // snapshot restored instead of loading a binary
+
+uint32_t* saved_frames      = (uint32_t*) 0; // hash index of saved frames by frame
+uint32_t* first_saved_frame = (uint32_t*) 0; // saved frames in snapshot order
+uint32_t* last_saved_frame  = (uint32_t*) 0;
+
+uint32_t number_of_saved_frames = 0;
+
 // *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~
 // -----------------------------------------------------------------
 // ----------------   T H E O R E M  P R O V E R    ----------------
@@ -4813,6 +5340,11 @@ void selfie_compile() {
   emit_write();
   emit_open();
   emit_malloc();
+  emit_mmap();
+  emit_lseek();
+  emit_unlink();
+  emit_fork();
+  emit_wait();
   emit_switch();
 
   // implicitly declare main procedure in global symbol table
@@ -5613,6 +6145,27 @@ uint32_t open_write_only(uint32_t* name) {
   return fd;
 }
 
+uint32_t open_read_write(uint32_t* name) {
+  // similar to opening write-only files except that Linux flags come
+  // first since Mac flags include O_APPEND (0x0400) on Linux which
+  // defeats seeking before writing
+  uint32_t fd;
+
+  // try Linux flags
+  fd = open(name, LINUX_O_CREAT_TRUNC_RDWR, S_IRUSR_IWUSR_IRGRP_IROTH);
+
+  if (signed_less_than(fd, 0)) {
+    // try Mac flags
+    fd = open(name, MAC_O_CREAT_TRUNC_RDWR, S_IRUSR_IWUSR_IRGRP_IROTH);
+
+    if (signed_less_than(fd, 0))
+      // try Windows flags
+      fd = open(name, WINDOWS_O_BINARY_CREAT_TRUNC_RDWR, S_IRUSR_IWUSR_IRGRP_IROTH);
+  }
+
+  return fd;
+}
+
 void selfie_output() {
   uint32_t fd;
 
@@ -5846,6 +6399,14 @@ void implement_read(uint32_t* context) {
   vbuffer = *(get_regs(context) + REG_A1);
   size    = *(get_regs(context) + REG_A2);
 
+  if (fd == 0)
+    if (save_snapshot_name != (uint32_t*) 0) {
+      // save warmed-up machine right before it reads its input
+      save_snapshot(context);
+
+      save_snapshot_name = (uint32_t*) 0;
+    }
+
   if (debug_read)
     printf4((uint32_t*) "%s: trying to read %d bytes from file with descriptor %d into buffer at virtual address %p\n", selfie_name, (uint32_t*) size, (uint32_t*) fd, (uint32_t*) vbuffer);
 
@@ -5856,7 +6417,13 @@ void implement_read(uint32_t* context) {
 
   while (size > 0) {
     if (is_valid_virtual_address(vbuffer)) {
+      // swapped and not yet loaded pages are mapped on demand
+      demand_page(context, get_page_of_virtual_address(vbuffer));
+
       if (is_virtual_address_mapped(get_pt(context), vbuffer)) {
+        if (is_page_read_only(get_pt(context), get_page_of_virtual_address(vbuffer)))
+          copy_on_write(context, get_page_of_virtual_address(vbuffer));
+
         buffer = tlb(get_pt(context), vbuffer);
 
         if (size < bytes_to_read)
@@ -5906,9 +6473,13 @@ void implement_read(uint32_t* context) {
 
             throw_exception(EXCEPTION_MAXTRACE, 0);
           }
-        } else
+        } else {
           actually_read = read(fd, buffer, bytes_to_read);
 
+          // reading into code invalidates decoded instructions
+          invalidate_decoded_instructions(context, vbuffer, bytes_to_read);
+        }
+
         if (actually_read == bytes_to_read) {
           read_total = read_total + actually_read;
 
@@ -6021,6 +6592,9 @@ void implement_write(uint32_t* context) {
 
   while (size > 0) {
     if (is_valid_virtual_address(vbuffer)) {
+      // swapped and not yet loaded pages are mapped on demand
+      demand_page(context, get_page_of_virtual_address(vbuffer));
+
       if (is_virtual_address_mapped(get_pt(context), vbuffer)) {
         buffer = tlb(get_pt(context), vbuffer);
 
@@ -6193,6 +6767,10 @@ void implement_openat(uint32_t* context) {
   flags     = *(get_regs(context) + REG_A2);
   mode      = *(get_regs(context) + REG_A3);
 
+  // file names span at most two pages
+  demand_page(context, get_page_of_virtual_address(vfilename));
+  demand_page(context, get_page_of_virtual_address(vfilename + MAX_FILENAME_LENGTH - 1));
+
   if (down_load_string(get_pt(context), vfilename, filename_buffer)) {
     fd = open(filename_buffer, flags, mode);
 
@@ -6370,121 +6948,394 @@ void implement_brk(uint32_t* context) {
   set_pc(context, get_pc(context) + INSTRUCTIONSIZE);
 }
 
+void emit_mmap() {
+  create_symbol_table_entry(LIBRARY_TABLE, (uint32_t*) "mmap", 0, PROCEDURE, UINT32STAR_T, 0, binary_length);
 
-// -----------------------------------------------------------------
-// ----------------------- HYPSTER SYSCALLS ------------------------
-// -----------------------------------------------------------------
+  // memory is only mapped through the host on boot level zero,
+  // on higher boot levels mmap ignores its six parameters and fails
+  emit_addi(REG_SP, REG_SP, 6 * REGISTERSIZE);
 
-void emit_switch() {
-  create_symbol_table_entry(LIBRARY_TABLE, (uint32_t*) "hypster_switch", 0, PROCEDURE, UINT32STAR_T, 0, binary_length);
+  emit_addi(REG_A0, REG_ZR, MAP_FAILED);
 
-  emit_lw(REG_A1, REG_SP, 0); // number of instructions to execute
-  emit_addi(REG_SP, REG_SP, REGISTERSIZE);
+  emit_jalr(REG_ZR, REG_RA, 0);
+}
 
-  emit_lw(REG_A0, REG_SP, 0); // context to which we switch
+void emit_lseek() {
+  create_symbol_table_entry(LIBRARY_TABLE, (uint32_t*) "lseek", 0, PROCEDURE, UINT32_T, 0, binary_length);
+
+  // files are only seeked through the host on boot level zero,
+  // on higher boot levels lseek ignores its three parameters and fails
+  emit_addi(REG_SP, REG_SP, 3 * REGISTERSIZE);
+
+  emit_addi(REG_A0, REG_ZR, -1);
+
+  emit_jalr(REG_ZR, REG_RA, 0);
+}
+
+void emit_unlink() {
+  create_symbol_table_entry(LIBRARY_TABLE, (uint32_t*) "unlink", 0, PROCEDURE, UINT32_T, 0, binary_length);
+
+  // files are only removed through the host on boot level zero,
+  // on higher boot levels unlink ignores its parameter and fails
   emit_addi(REG_SP, REG_SP, REGISTERSIZE);
 
-  emit_addi(REG_A7, REG_ZR, SYSCALL_SWITCH);
+  emit_addi(REG_A0, REG_ZR, -1);
 
-  emit_ecall();
+  emit_jalr(REG_ZR, REG_RA, 0);
+}
 
-  // save context from which we are switching here in return register
-  emit_addi(REG_A0, REG_A1, 0);
+void emit_fork() {
+  create_symbol_table_entry(LIBRARY_TABLE, (uint32_t*) "fork", 0, PROCEDURE, UINT32_T, 0, binary_length);
 
+  emit_addi(REG_A7, REG_ZR, SYSCALL_FORK);
+
+  emit_ecall();
+
+  // jump back to caller, return value is in REG_A0
   emit_jalr(REG_ZR, REG_RA, 0);
 }
 
-void do_switch(uint32_t* to_context, uint32_t timeout) {
-  uint32_t* from_context;
+void implement_fork(uint32_t* context) {
+  // local variables
+  uint32_t* child;
+  uint32_t* table;
+  uint32_t  page;
+  uint32_t  frame;
+  uint32_t  r;
 
-  from_context = current_context;
+  if (disassemble)
+    print((uint32_t*) "(fork): |- ");
 
-  restore_context(to_context);
+  child = create_context(MY_CONTEXT, (uint32_t*) 0);
 
-  // restore machine state
-  pc        = get_pc(to_context);
-  registers = get_regs(to_context);
-  pt        = get_pt(to_context);
+  adopt_child(context, child);
 
-  // use REG_A1 instead of REG_A0 to avoid race condition with interrupt
-  if (get_parent(from_context) != MY_CONTEXT)
-    *(registers + REG_A1) = (uint32_t) get_virtual_context(from_context);
-  else
-    *(registers + REG_A1) = (uint32_t) from_context;
+  set_name(child, get_name(context));
 
-  current_context = to_context;
+  // child continues right after the system call
+  set_pc(child, get_pc(context) + INSTRUCTIONSIZE);
 
-  timer = timeout;
+  r = 0;
 
-  if (debug_switch) {
-    printf3((uint32_t*) "%s: switched from context %p to context %p", selfie_name, from_context, to_context);
-    if (timer != TIMEROFF)
-      printf1((uint32_t*) " to execute %d instructions", (uint32_t*) timer);
-    println();
+  while (r < NUMBEROFREGISTERS) {
+    *(get_regs(child) + r) = *(get_regs(context) + r);
+
+    r = r + 1;
   }
-}
 
-void implement_switch() {
-  if (disassemble) {
-    print((uint32_t*) "(switch): ");
-    print_register_hexadecimal(REG_A0);
-    print((uint32_t*) ",");
-    print_register_value(REG_A1);
-    print((uint32_t*) " |- ");
-    print_register_value(REG_A1);
+  set_original_break(child, get_original_break(context));
+  set_program_break(child, get_program_break(context));
+
+  table = get_pt(context);
+
+  page = 0;
+
+  // share all mapped pages read-only until either context writes to them
+  while (page < VIRTUALMEMORYSIZE / PAGESIZE) {
+    if (*(table + page / LEAFTABLEPAGES) == 0)
+      // skip pages without leaf table
+      page = page + LEAFTABLEPAGES;
+    else {
+      frame = get_frame_for_page(table, page);
+
+      if (frame != 0) {
+        share_frame(frame);
+
+        write_protect_page(table, page);
+
+        map_page(child, page, frame);
+
+        write_protect_page(get_pt(child), page);
+      }
+
+      page = page + 1;
+    }
   }
 
-  save_context(current_context);
+  duplicate_swapped_pages(context, child);
 
-  // cache context on my boot level before switching
-  do_switch(cache_context((uint32_t*) *(registers + REG_A0)), *(registers + REG_A1));
+  // cached translations of the parent may be writable
+  flush_tlb(get_software_tlb(context));
+
+  // hosting boot levels restore all pages of the parent again
+  set_lo_page(context, 0);
+  set_hi_page(context, get_page_of_virtual_address(VIRTUALMEMORYSIZE - REGISTERSIZE));
+  set_dirty_pages(context, DIRTYPAGES + 1);
+
+  *(get_regs(child) + REG_A0) = 0;
+
+  *(get_regs(context) + REG_A0) = get_pid(child);
+
+  make_ready(child);
 
   if (disassemble) {
     print((uint32_t*) " -> ");
-    print_register_hexadecimal(REG_A1);
+    print_register_value(REG_A0);
     println();
   }
+
+  set_pc(context, get_pc(context) + INSTRUCTIONSIZE);
 }
 
-uint32_t* mipster_switch(uint32_t* to_context, uint32_t timeout) {
-  do_switch(to_context, timeout);
+void emit_wait() {
+  create_symbol_table_entry(LIBRARY_TABLE, (uint32_t*) "wait", 0, PROCEDURE, UINT32_T, 0, binary_length);
 
-  run_until_exception();
+  emit_lw(REG_A0, REG_SP, 0); // *wstatus
+  emit_addi(REG_SP, REG_SP, REGISTERSIZE);
 
-  save_context(current_context);
+  emit_addi(REG_A7, REG_ZR, SYSCALL_WAIT);
 
-  return current_context;
-}
+  emit_ecall();
 
-uint32_t* hypster_switch(uint32_t* to_context, uint32_t timeout) {
-  // this procedure is only executed at boot level zero
-  return mipster_switch(to_context, timeout);
+  // jump back to caller, return value is in REG_A0
+  emit_jalr(REG_ZR, REG_RA, 0);
 }
 
-// *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~
-// -----------------------------------------------------------------
-// ----------------------    R U N T I M E    ----------------------
-// -----------------------------------------------------------------
-// *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~
+void implement_wait(uint32_t* context) {
+  // parameter
+  uint32_t vstatus;
 
-// -----------------------------------------------------------------
-// ---------------------------- MEMORY -----------------------------
-// -----------------------------------------------------------------
+  // local variables
+  uint32_t* child;
+  uint32_t* previous;
 
-uint32_t load_physical_memory(uint32_t* paddr) {
-  return *paddr;
-}
+  if (disassemble) {
+    print((uint32_t*) "(wait): ");
+    print_register_hexadecimal(REG_A0);
+    print((uint32_t*) " |- ");
+    print_register_value(REG_A0);
+  }
+
+  vstatus = *(get_regs(context) + REG_A0);
+
+  previous = (uint32_t*) 0;
+
+  child = get_children(context);
+
+  // only children of context are searched for one that exited
+  while (child != (uint32_t*) 0) {
+    if (get_state(child) == STATE_EXITED) {
+      if (vstatus != 0)
+        if (is_valid_virtual_address(vstatus))
+          map_and_store(context, vstatus, get_exit_code(child));
+
+      *(get_regs(context) + REG_A0) = get_pid(child);
+
+      if (previous == (uint32_t*) 0)
+        set_children(context, get_next_sibling(child));
+      else
+        set_next_sibling(previous, get_next_sibling(child));
+
+      reap_context(child);
+
+      if (disassemble) {
+        print((uint32_t*) " -> ");
+        print_register_value(REG_A0);
+        println();
+      }
+
+      set_pc(context, get_pc(context) + INSTRUCTIONSIZE);
+
+      return;
+    }
+
+    previous = child;
+
+    child = get_next_sibling(child);
+  }
+
+  if (get_children(context) != (uint32_t*) 0) {
+    if (disassemble)
+      print((uint32_t*) " -> blocked\n");
+
+    // wait again when a child exits
+    block_context(context);
+  } else {
+    // no child to wait for
+    *(get_regs(context) + REG_A0) = -1;
+
+    if (disassemble) {
+      print((uint32_t*) " -> ");
+      print_register_value(REG_A0);
+      println();
+    }
+
+    set_pc(context, get_pc(context) + INSTRUCTIONSIZE);
+  }
+}
+
+
+// -----------------------------------------------------------------
+// ----------------------- HYPSTER SYSCALLS ------------------------
+// -----------------------------------------------------------------
+
+void emit_switch() {
+  create_symbol_table_entry(LIBRARY_TABLE, (uint32_t*) "hypster_switch", 0, PROCEDURE, UINT32STAR_T, 0, binary_length);
+
+  emit_lw(REG_A1, REG_SP, 0); // number of instructions to execute
+  emit_addi(REG_SP, REG_SP, REGISTERSIZE);
+
+  emit_lw(REG_A0, REG_SP, 0); // context to which we switch
+  emit_addi(REG_SP, REG_SP, REGISTERSIZE);
+
+  emit_addi(REG_A7, REG_ZR, SYSCALL_SWITCH);
+
+  emit_ecall();
+
+  // save context from which we are switching here in return register
+  emit_addi(REG_A0, REG_A1, 0);
+
+  emit_jalr(REG_ZR, REG_RA, 0);
+}
+
+void do_switch(uint32_t* to_context, uint32_t timeout) {
+  uint32_t* from_context;
+
+  from_context = current_context;
+
+  restore_context(to_context);
+
+  if (debug == 0)
+    if (get_decode_length(to_context) < code_length) {
+      // allocate zeroed memory for decoded instruction cache
+      // covering the code segment up to its last page boundary
+      set_decode_cache(to_context, zalloc(round_up(code_length, PAGESIZE) / INSTRUCTIONSIZE * DECODEDINSTRUCTIONSIZE * REGISTERSIZE));
+      set_decode_length(to_context, code_length);
+    }
+
+  if (get_software_tlb(to_context) == (uint32_t*) 0)
+    // allocate zeroed memory for empty software tlb
+    set_software_tlb(to_context, zalloc(TLBENTRIES * TLBENTRYSIZE * REGISTERSIZE));
+
+  // restore machine state, switching software tlbs
+  // flushes cached translations of the previous context
+  pc        = get_pc(to_context);
+  registers = get_regs(to_context);
+  pt        = get_pt(to_context);
+  dcache    = get_decode_cache(to_context);
+  dcache_length = get_decode_length(to_context);
+  stlb      = get_software_tlb(to_context);
+
+  // use REG_A1 instead of REG_A0 to avoid race condition with interrupt,
+  // a context that just continues does not switch from any context
+  if (from_context != to_context) {
+    if (get_parent(from_context) != MY_CONTEXT)
+      *(registers + REG_A1) = (uint32_t) get_virtual_context(from_context);
+    else
+      *(registers + REG_A1) = (uint32_t) from_context;
+  }
+
+  current_context = to_context;
+
+  timer = timeout;
+
+  if (debug_switch) {
+    printf3((uint32_t*) "%s: switched from context %p to context %p", selfie_name, from_context, to_context);
+    if (timer != TIMEROFF)
+      printf1((uint32_t*) " to execute %d instructions", (uint32_t*) timer);
+    println();
+  }
+}
+
+void implement_switch() {
+  if (disassemble) {
+    print((uint32_t*) "(switch): ");
+    print_register_hexadecimal(REG_A0);
+    print((uint32_t*) ",");
+    print_register_value(REG_A1);
+    print((uint32_t*) " |- ");
+    print_register_value(REG_A1);
+  }
+
+  save_context(current_context);
+
+  // cache context on my boot level before switching
+  do_switch(cache_context((uint32_t*) *(registers + REG_A0)), *(registers + REG_A1));
+
+  if (disassemble) {
+    print((uint32_t*) " -> ");
+    print_register_hexadecimal(REG_A1);
+    println();
+  }
+}
+
+uint32_t* mipster_switch(uint32_t* to_context, uint32_t timeout) {
+  do_switch(to_context, timeout);
+
+  run_until_exception();
+
+  save_context(current_context);
+
+  return current_context;
+}
+
+uint32_t* hypster_switch(uint32_t* to_context, uint32_t timeout) {
+  // this procedure is only executed at boot level zero
+  return mipster_switch(to_context, timeout);
+}
+
+// *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~
+// -----------------------------------------------------------------
+// ----------------------    R U N T I M E    ----------------------
+// -----------------------------------------------------------------
+// *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~
+
+// -----------------------------------------------------------------
+// ---------------------------- MEMORY -----------------------------
+// -----------------------------------------------------------------
+
+uint32_t load_physical_memory(uint32_t* paddr) {
+  return *paddr;
+}
 
 void store_physical_memory(uint32_t* paddr, uint32_t data) {
   *paddr = data;
 }
 
-uint32_t frame_for_page(uint32_t* table, uint32_t page) {
-  return (uint32_t) (table + page);
+uint32_t* allocate_page_table() {
+  // allocate zeroed memory for root table only
+  return zalloc(VIRTUALMEMORYSIZE / PAGESIZE / LEAFTABLEPAGES * SIZEOFUINT32STAR);
 }
 
 uint32_t get_frame_for_page(uint32_t* table, uint32_t page) {
-  return *(table + page);
+  uint32_t* leaf;
+  uint32_t frame;
+
+  leaf = (uint32_t*) *(table + page / LEAFTABLEPAGES);
+
+  if (leaf != (uint32_t*) 0) {
+    frame = *(leaf + page % LEAFTABLEPAGES);
+
+    // ignore read-only mark
+    return frame - frame % PAGESIZE;
+  } else
+    return 0;
+}
+
+void set_frame_for_page(uint32_t* table, uint32_t page, uint32_t frame) {
+  uint32_t* leaf;
+
+  leaf = (uint32_t*) *(table + page / LEAFTABLEPAGES);
+
+  if (leaf == (uint32_t*) 0) {
+    // allocate zeroed memory for leaf table on first use, page-aligned
+    // for hosting boot levels to tell leaf tables from anything else
+    leaf = (uint32_t*) round_up((uint32_t) zalloc(LEAFTABLEPAGES * REGISTERSIZE + PAGESIZE - REGISTERSIZE), PAGESIZE);
+
+    *(table + page / LEAFTABLEPAGES) = (uint32_t) leaf;
+  }
+
+  *(leaf + page % LEAFTABLEPAGES) = frame;
+}
+
+void unmap_page(uint32_t* table, uint32_t page) {
+  uint32_t* leaf;
+
+  leaf = (uint32_t*) *(table + page / LEAFTABLEPAGES);
+
+  // pages without leaf table are unmapped already
+  if (leaf != (uint32_t*) 0)
+    *(leaf + page % LEAFTABLEPAGES) = 0;
 }
 
 uint32_t is_page_mapped(uint32_t* table, uint32_t page) {
@@ -6494,6 +7345,28 @@ uint32_t is_page_mapped(uint32_t* table, uint32_t page) {
     return 0;
 }
 
+uint32_t is_page_read_only(uint32_t* table, uint32_t page) {
+  uint32_t* leaf;
+
+  leaf = (uint32_t*) *(table + page / LEAFTABLEPAGES);
+
+  if (leaf != (uint32_t*) 0)
+    if (*(leaf + page % LEAFTABLEPAGES) % PAGESIZE == READONLY)
+      return 1;
+
+  return 0;
+}
+
+void write_protect_page(uint32_t* table, uint32_t page) {
+  uint32_t* leaf;
+
+  // assert: page is mapped
+
+  leaf = (uint32_t*) *(table + page / LEAFTABLEPAGES);
+
+  *(leaf + page % LEAFTABLEPAGES) = get_frame_for_page(table, page) + READONLY;
+}
+
 uint32_t is_valid_virtual_address(uint32_t vaddr) {
   if (vaddr < VIRTUALMEMORYSIZE)
     // memory must be word-addressed for lack of byte-sized data type
@@ -6534,6 +7407,108 @@ uint32_t* tlb(uint32_t* table, uint32_t vaddr) {
   return (uint32_t*) paddr;
 }
 
+void flush_tlb(uint32_t* cache) {
+  uint32_t i;
+
+  if (cache != (uint32_t*) 0) {
+    i = 0;
+
+    while (i < TLBENTRIES) {
+      *(cache + i * TLBENTRYSIZE)     = 0;
+      *(cache + i * TLBENTRYSIZE + 2) = 0;
+
+      i = i + 1;
+    }
+  }
+}
+
+void flush_tlb_entry(uint32_t* cache, uint32_t page) {
+  if (cache != (uint32_t*) 0) {
+    *(cache + page % TLBENTRIES * TLBENTRYSIZE)     = 0;
+    *(cache + page % TLBENTRIES * TLBENTRYSIZE + 2) = 0;
+  }
+}
+
+uint32_t is_page_cached(uint32_t* cache, uint32_t page) {
+  if (cache != (uint32_t*) 0)
+    if (*(cache + page % TLBENTRIES * TLBENTRYSIZE) == page + 1)
+      return 1;
+
+  return 0;
+}
+
+uint32_t* lookup_tlb(uint32_t* cache, uint32_t* table, uint32_t vaddr) {
+  uint32_t page;
+  uint32_t* entry;
+  uint32_t paddr;
+
+  // translate vaddr to physical address, or return 0 if vaddr
+  // is invalid or unmapped, using a direct-mapped tlb that only
+  // caches translations of valid and mapped pages
+
+  if (vaddr % REGISTERSIZE != 0)
+    // memory must be word-addressed for lack of byte-sized data type
+    return (uint32_t*) 0;
+
+  page = vaddr / PAGESIZE;
+
+  entry = cache + page % TLBENTRIES * TLBENTRYSIZE;
+
+  if (*entry == page + 1)
+    tlb_hits = tlb_hits + 1;
+  else {
+    tlb_misses = tlb_misses + 1;
+
+    if (vaddr >= VIRTUALMEMORYSIZE)
+      return (uint32_t*) 0;
+    else if (get_frame_for_page(table, page) == 0)
+      return (uint32_t*) 0;
+
+    *entry       = page + 1;
+    *(entry + 1) = get_frame_for_page(table, page);
+
+    if (is_page_read_only(table, page))
+      *(entry + 2) = 0;
+    else
+      *(entry + 2) = page + 1;
+  }
+
+  // map virtual address to physical address
+  paddr = vaddr - page * PAGESIZE + *(entry + 1);
+
+  if (debug_tlb)
+    printf5((uint32_t*) "%s: tlb lookup:\n vaddr: %p\n page:  %p\n frame: %p\n paddr: %p\n", selfie_name, (uint32_t*) vaddr, (uint32_t*) (page * PAGESIZE), (uint32_t*) *(entry + 1), (uint32_t*) paddr);
+
+  return (uint32_t*) paddr;
+}
+
+uint32_t* lookup_writable_tlb(uint32_t* cache, uint32_t* table, uint32_t vaddr) {
+  uint32_t page;
+  uint32_t* entry;
+  uint32_t* paddr;
+
+  // like lookup_tlb but also return 0 if vaddr is on a read-only page
+
+  page = vaddr / PAGESIZE;
+
+  entry = cache + page % TLBENTRIES * TLBENTRYSIZE;
+
+  if (*(entry + 2) == page + 1)
+    if (vaddr % REGISTERSIZE == 0) {
+      // write tag implies tag
+      tlb_hits = tlb_hits + 1;
+
+      return (uint32_t*) (vaddr - page * PAGESIZE + *(entry + 1));
+    }
+
+  paddr = lookup_tlb(cache, table, vaddr);
+
+  if (*(entry + 2) != page + 1)
+    return (uint32_t*) 0;
+
+  return paddr;
+}
+
 uint32_t load_virtual_memory(uint32_t* table, uint32_t vaddr) {
   // assert: is_valid_virtual_address(vaddr) == 1
   // assert: is_virtual_address_mapped(table, vaddr) == 1
@@ -6548,6 +7523,67 @@ void store_virtual_memory(uint32_t* table, uint32_t vaddr, uint32_t data) {
   store_physical_memory(tlb(table, vaddr), data);
 }
 
+void load_virtual_words(uint32_t* table, uint32_t vaddr, uint32_t* data, uint32_t bytes) {
+  uint32_t* paddr;
+  uint32_t size;
+  uint32_t i;
+
+  // assert: vaddr and bytes are multiples of REGISTERSIZE
+  // assert: all pages from vaddr to vaddr + bytes are mapped
+
+  while (bytes > 0) {
+    // translate once, then copy up to the end of the page
+    size = PAGESIZE - vaddr % PAGESIZE;
+
+    if (size > bytes)
+      size = bytes;
+
+    paddr = tlb(table, vaddr);
+
+    i = 0;
+
+    while (i < size / REGISTERSIZE) {
+      *(data + i) = *(paddr + i);
+
+      i = i + 1;
+    }
+
+    vaddr = vaddr + size;
+    data  = data + size / REGISTERSIZE;
+    bytes = bytes - size;
+  }
+}
+
+void store_virtual_words(uint32_t* table, uint32_t vaddr, uint32_t* data, uint32_t bytes) {
+  uint32_t* paddr;
+  uint32_t size;
+  uint32_t i;
+
+  // assert: vaddr and bytes are multiples of REGISTERSIZE
+  // assert: all pages from vaddr to vaddr + bytes are mapped
+
+  while (bytes > 0) {
+    size = PAGESIZE - vaddr % PAGESIZE;
+
+    if (size > bytes)
+      size = bytes;
+
+    paddr = tlb(table, vaddr);
+
+    i = 0;
+
+    while (i < size / REGISTERSIZE) {
+      *(paddr + i) = *(data + i);
+
+      i = i + 1;
+    }
+
+    vaddr = vaddr + size;
+    data  = data + size / REGISTERSIZE;
+    bytes = bytes - size;
+  }
+}
+
 // -----------------------------------------------------------------
 // ------------------------- INSTRUCTIONS --------------------------
 // -----------------------------------------------------------------
@@ -7258,31 +8294,33 @@ void record_lw() {
 
 uint32_t do_lw() {
   uint32_t vaddr;
+  uint32_t* paddr;
   uint32_t a;
 
   // load word
 
   vaddr = *(registers + rs1) + imm;
 
-  if (is_valid_virtual_address(vaddr)) {
-    if (is_virtual_address_mapped(pt, vaddr)) {
-      if (rd != REG_ZR)
-        // semantics of lw
-        *(registers + rd) = load_virtual_memory(pt, vaddr);
+  paddr = lookup_tlb(stlb, pt, vaddr);
 
-      // keep track of instruction address for profiling loads
-      a = (pc - entry_point) / INSTRUCTIONSIZE;
+  if (paddr != (uint32_t*) 0) {
+    if (rd != REG_ZR)
+      // semantics of lw
+      *(registers + rd) = load_physical_memory(paddr);
 
-      pc = pc + INSTRUCTIONSIZE;
+    // keep track of instruction address for profiling loads
+    a = (pc - entry_point) / INSTRUCTIONSIZE;
 
-      // keep track of number of loads in total
-      ic_lw = ic_lw + 1;
+    pc = pc + INSTRUCTIONSIZE;
 
-      // and individually
-      *(loads_per_instruction + a) = *(loads_per_instruction + a) + 1;
-    } else
-      throw_exception(EXCEPTION_PAGEFAULT, get_page_of_virtual_address(vaddr));
-  } else
+    // keep track of number of loads in total
+    ic_lw = ic_lw + 1;
+
+    // and individually
+    *(loads_per_instruction + a) = *(loads_per_instruction + a) + 1;
+  } else if (is_valid_virtual_address(vaddr))
+    throw_exception(EXCEPTION_PAGEFAULT, get_page_of_virtual_address(vaddr));
+  else
     throw_exception(EXCEPTION_INVALIDADDRESS, vaddr);
 
   return vaddr;
@@ -7385,28 +8423,37 @@ void record_sw() {
 
 uint32_t do_sw() {
   uint32_t vaddr;
+  uint32_t* paddr;
   uint32_t a;
 
   // store word
 
   vaddr = *(registers + rs1) + imm;
 
-  if (is_valid_virtual_address(vaddr)) {
-    if (is_virtual_address_mapped(pt, vaddr)) {
-      // semantics of sw
-      store_virtual_memory(pt, vaddr, *(registers + rs2));
+  paddr = lookup_writable_tlb(stlb, pt, vaddr);
 
-      // keep track of instruction address for profiling stores
-      a = (pc - entry_point) / INSTRUCTIONSIZE;
+  if (paddr != (uint32_t*) 0) {
+    // semantics of sw
+    store_physical_memory(paddr, *(registers + rs2));
 
-      pc = pc + INSTRUCTIONSIZE;
+    // stores into code invalidate decoded instructions
+    invalidate_decoded_instructions(current_context, vaddr, REGISTERSIZE);
 
-      // keep track of number of stores in total
-      ic_sw = ic_sw + 1;
+    // keep track of instruction address for profiling stores
+    a = (pc - entry_point) / INSTRUCTIONSIZE;
 
-      // and individually
-      *(stores_per_instruction + a) = *(stores_per_instruction + a) + 1;
-    } else
+    pc = pc + INSTRUCTIONSIZE;
+
+    // keep track of number of stores in total
+    ic_sw = ic_sw + 1;
+
+    // and individually
+    *(stores_per_instruction + a) = *(stores_per_instruction + a) + 1;
+  } else if (is_valid_virtual_address(vaddr)) {
+    if (is_virtual_address_mapped(pt, vaddr))
+      // page is read-only
+      throw_exception(EXCEPTION_WRITEFAULT, get_page_of_virtual_address(vaddr));
+    else
       throw_exception(EXCEPTION_PAGEFAULT, get_page_of_virtual_address(vaddr));
   } else
     throw_exception(EXCEPTION_INVALIDADDRESS, vaddr);
@@ -7627,6 +8674,31 @@ void record_ecall() {
   record_state(*(registers + REG_A0));
 }
 
+uint32_t is_inline_system_call() {
+  uint32_t a7;
+
+  // the reference engine handles all system calls by exception
+  if (debug)
+    return 0;
+  else if (get_parent(current_context) != MY_CONTEXT)
+    // hosted contexts are handled by their parents
+    return 0;
+
+  a7 = *(registers + REG_A7);
+
+  // fork, wait, and exit involve the scheduler
+  if (a7 == SYSCALL_BRK)
+    return 1;
+  else if (a7 == SYSCALL_READ)
+    return 1;
+  else if (a7 == SYSCALL_WRITE)
+    return 1;
+  else if (a7 == SYSCALL_OPENAT)
+    return 1;
+  else
+    return 0;
+}
+
 void do_ecall() {
   ic_ecall = ic_ecall + 1;
 
@@ -7644,13 +8716,28 @@ void do_ecall() {
       printf1((uint32_t*) "%s: context switching during symbolic execution is unsupported\n", selfie_name);
 
       exit(EXITCODE_BADARGUMENTS);
-    } else {
-      pc = pc + INSTRUCTIONSIZE;
-
-      implement_switch();
-    }
+    } else
+      execute_ecall();
   else
-    // all system calls other than switch are handled by exception
+    execute_ecall();
+}
+
+void execute_ecall() {
+  // ecall without counting it
+  if (*(registers + REG_A7) == SYSCALL_SWITCH) {
+    pc = pc + INSTRUCTIONSIZE;
+
+    implement_switch();
+  } else if (is_inline_system_call()) {
+    // handle system call without leaving the interpreter loop,
+    // system call implementations access the pc of the context
+    set_pc(current_context, pc);
+
+    handle_system_call(current_context);
+
+    pc = get_pc(current_context);
+  } else
+    // all other system calls are handled by exception
     throw_exception(EXCEPTION_SYSCALL, 0);
 }
 
@@ -8207,18 +9294,25 @@ void throw_exception(uint32_t exception, uint32_t faulting_page) {
 }
 
 void fetch() {
-  // assert: is_valid_virtual_address(pc) == 1
-  // assert: is_virtual_address_mapped(pt, pc) == 1
+  uint32_t* paddr;
 
-  ir = load_virtual_memory(pt, pc);
-}
+  paddr = lookup_tlb(stlb, pt, pc);
 
-void decode_execute() {
-  opcode = get_opcode(ir);
+  if (paddr != (uint32_t*) 0)
+    ir = load_physical_memory(paddr);
+  else {
+    // pages of hosted contexts may not be mapped by their parents
+    ir = 0;
 
-  if (opcode == OP_IMM) {
-    decode_i_format();
+    if (is_valid_virtual_address(pc))
+      throw_exception(EXCEPTION_PAGEFAULT, get_page_of_virtual_address(pc));
+    else
+      throw_exception(EXCEPTION_INVALIDADDRESS, pc);
+  }
+}
 
+void execute_instruction() {
+  if (opcode == OP_IMM) {
     if (funct3 == F3_ADDI) {
       if (debug) {
         if (record) {
@@ -8244,8 +9338,6 @@ void decode_execute() {
       return;
     }
   } else if (opcode == OP_LW) {
-    decode_i_format();
-
     if (funct3 == F3_LW) {
       if (debug) {
         if (record) {
@@ -8268,8 +9360,6 @@ void decode_execute() {
       return;
     }
   } else if (opcode == OP_SW) {
-    decode_s_format();
-
     if (funct3 == F3_SW) {
       if (debug) {
         if (record) {
@@ -8294,8 +9384,6 @@ void decode_execute() {
       return;
     }
   } else if (opcode == OP_OP) { // could be ADD, SUB, MUL, DIVU, REMU, SLTU
-    decode_r_format();
-
     if (funct3 == F3_ADD) { // = F3_SUB = F3_MUL
       if (funct7 == F7_ADD) {
         if (debug) {
@@ -8442,8 +9530,6 @@ void decode_execute() {
       }
     }
   } else if (opcode == OP_BRANCH) {
-    decode_b_format();
-
     if (funct3 == F3_BEQ) {
       if (debug) {
         if (record) {
@@ -8465,8 +9551,6 @@ void decode_execute() {
       return;
     }
   } else if (opcode == OP_JAL) {
-    decode_j_format();
-
     if (debug) {
       if (record) {
         record_lui_addi_add_sub_mul_sltu_jal_jalr();
@@ -8490,8 +9574,6 @@ void decode_execute() {
 
     return;
   } else if (opcode == OP_JALR) {
-    decode_i_format();
-
     if (funct3 == F3_JALR) {
       if (debug) {
         if (record) {
@@ -8517,8 +9599,6 @@ void decode_execute() {
       return;
     }
   } else if (opcode == OP_LUI) {
-    decode_u_format();
-
     if (debug) {
       if (record) {
         record_lui_addi_add_sub_mul_sltu_jal_jalr();
@@ -8542,8 +9622,6 @@ void decode_execute() {
 
     return;
   } else if (opcode == OP_SYSTEM) {
-    decode_i_format();
-
     if (funct3 == F3_ECALL) {
       if (debug) {
         if (record) {
@@ -8580,657 +9658,3871 @@ void decode_execute() {
   }
 }
 
-void interrupt() {
-  if (timer != TIMEROFF) {
-    timer = timer - 1;
+void decode() {
+  opcode = get_opcode(ir);
 
-    if (timer == 0) {
-      if (get_exception(current_context) == EXCEPTION_NOEXCEPTION)
-        // only throw exception if no other is pending
-        // TODO: handle multiple pending exceptions
-        throw_exception(EXCEPTION_TIMER, 0);
-      else
-        // trigger timer in the next interrupt cycle
-        timer = 1;
-    }
-  }
+  if (opcode == OP_IMM)
+    decode_i_format();
+  else if (opcode == OP_LW)
+    decode_i_format();
+  else if (opcode == OP_SW)
+    decode_s_format();
+  else if (opcode == OP_OP)
+    decode_r_format();
+  else if (opcode == OP_BRANCH)
+    decode_b_format();
+  else if (opcode == OP_JAL)
+    decode_j_format();
+  else if (opcode == OP_JALR)
+    decode_i_format();
+  else if (opcode == OP_LUI)
+    decode_u_format();
+  else if (opcode == OP_SYSTEM)
+    decode_i_format();
 }
 
-uint32_t* run_until_exception() {
-  trap = 0;
-
-  while (trap == 0) {
-    fetch();
-    decode_execute();
-    interrupt();
-  }
-
-  trap = 0;
+void decode_execute() {
+  decode();
+  execute_instruction();
+}
 
-  return current_context;
+uint32_t decode_handler() {
+  // assert: instruction in ir is decoded
+  if (opcode == OP_IMM) {
+    if (funct3 == F3_ADDI)
+      return HANDLER_ADDI;
+  } else if (opcode == OP_LW) {
+    if (funct3 == F3_LW)
+      return HANDLER_LW;
+  } else if (opcode == OP_SW) {
+    if (funct3 == F3_SW)
+      return HANDLER_SW;
+  } else if (opcode == OP_OP) {
+    if (funct3 == F3_ADD) { // = F3_SUB = F3_MUL
+      if (funct7 == F7_ADD)
+        return HANDLER_ADD;
+      else if (funct7 == F7_SUB)
+        return HANDLER_SUB;
+      else if (funct7 == F7_MUL)
+        return HANDLER_MUL;
+    } else if (funct3 == F3_DIVU) {
+      if (funct7 == F7_DIVU)
+        return HANDLER_DIVU;
+    } else if (funct3 == F3_REMU) {
+      if (funct7 == F7_REMU)
+        return HANDLER_REMU;
+    } else if (funct3 == F3_SLTU) {
+      if (funct7 == F7_SLTU)
+        return HANDLER_SLTU;
+    }
+  } else if (opcode == OP_BRANCH) {
+    if (funct3 == F3_BEQ)
+      return HANDLER_BEQ;
+  } else if (opcode == OP_JAL)
+    return HANDLER_JAL;
+  else if (opcode == OP_JALR) {
+    if (funct3 == F3_JALR)
+      return HANDLER_JALR;
+  } else if (opcode == OP_LUI)
+    return HANDLER_LUI;
+  else if (opcode == OP_SYSTEM) {
+    if (funct3 == F3_ECALL)
+      return HANDLER_ECALL;
+  }
+
+  return HANDLER_UNKNOWN;
+}
+
+uint32_t* decoded_instruction(uint32_t* cache, uint32_t length, uint32_t vaddr) {
+  // assert: cache != (uint32_t*) 0 if length > 0
+  if (vaddr - entry_point < length)
+    return cache + (vaddr - entry_point) / INSTRUCTIONSIZE * DECODEDINSTRUCTIONSIZE;
+  else
+    // outside of the code segment nothing is cached
+    return (uint32_t*) 0;
 }
 
-uint32_t instruction_with_max_counter(uint32_t* counters, uint32_t max) {
-  uint32_t a;
-  uint32_t n;
+void invalidate_decoded_instructions(uint32_t* context, uint32_t vaddr, uint32_t bytes) {
+  uint32_t* entry;
   uint32_t i;
-  uint32_t c;
 
-  a = UINT32_MAX;
+  if (get_decode_cache(context) != (uint32_t*) 0) {
+    // assert: vaddr to vaddr + bytes is either inside or outside of code segment
+    entry = decoded_instruction(get_decode_cache(context), get_decode_length(context), vaddr);
 
-  n = 0;
-  i = 0;
+    if (entry != (uint32_t*) 0) {
+      i = 1;
 
-  while (i < code_length / INSTRUCTIONSIZE) {
-    c = *(counters + i);
+      // superinstructions starting before vaddr may include vaddr
+      while (i < MAX_SUPERINSTRUCTION_LENGTH) {
+        if (vaddr - entry_point >= i * INSTRUCTIONSIZE)
+          *(entry - i * DECODEDINSTRUCTIONSIZE + 7) = HANDLER_NONE;
 
-    if (n < c) {
-      if (c < max) {
-        n = c;
-        a = i;
-      } else
-        return i * INSTRUCTIONSIZE;
+        i = i + 1;
+      }
     }
 
-    i = i + 1;
-  }
+    if (entry != (uint32_t*) 0)
+      while (bytes > 0) {
+        *entry       = HANDLER_NONE;
+        *(entry + 5) = 0;
+        *(entry + 7) = HANDLER_NONE;
 
-  if (a != UINT32_MAX)
-    return a * INSTRUCTIONSIZE;
-  else
-    return UINT32_MAX;
-}
+        entry = entry + DECODEDINSTRUCTIONSIZE;
 
-uint32_t print_per_instruction_counter(uint32_t total, uint32_t* counters, uint32_t max) {
-  uint32_t a;
-  uint32_t c;
+        if (bytes > INSTRUCTIONSIZE)
+          bytes = bytes - INSTRUCTIONSIZE;
+        else
+          bytes = 0;
+      }
+  }
+}
 
-  a = instruction_with_max_counter(counters, max);
+uint32_t fetch_decode() {
+  uint32_t* entry;
+  uint32_t handler;
+
+  entry = decoded_instruction(dcache, dcache_length, pc);
+
+  if (entry != (uint32_t*) 0)
+    if (*entry != HANDLER_NONE) {
+      // cache hit: no need to fetch and decode again
+      rs1 = *(entry + 1);
+      rs2 = *(entry + 2);
+      rd  = *(entry + 3);
+      imm = *(entry + 4);
+
+      if (*(entry + 7) != HANDLER_NONE) {
+        // superinstructions only run if the timer
+        // cannot expire before their last instruction
+        if (timer == TIMEROFF)
+          return *(entry + 7);
+        else if (timer > superinstruction_length(*(entry + 7)))
+          return *(entry + 7);
+      }
 
-  if (a != UINT32_MAX) {
-    c = *(counters + a / INSTRUCTIONSIZE);
+      return *entry;
+    }
 
-    // CAUTION: we reset counter to avoid reporting it again
-    *(counters + a / INSTRUCTIONSIZE) = 0;
+  fetch();
+
+  if (trap)
+    // faulting fetch executes nothing
+    return HANDLER_NONE;
+
+  decode();
+
+  handler = decode_handler();
+
+  if (entry != (uint32_t*) 0) {
+    *entry       = handler;
+    *(entry + 1) = rs1;
+    *(entry + 2) = rs2;
+    *(entry + 3) = rd;
+    *(entry + 4) = imm;
+    *(entry + 5) = 0;
+    *(entry + 6) = 0;
+    *(entry + 7) = HANDLER_NONE;
+
+    fuse_decoded_instructions(entry, pc);
+  }
+
+  return handler;
+}
+
+void execute_handler(uint32_t handler) {
+  if (handler == HANDLER_ADDI)
+    do_addi();
+  else if (handler == HANDLER_LW)
+    do_lw();
+  else if (handler == HANDLER_SW)
+    do_sw();
+  else if (handler == HANDLER_JAL)
+    do_jal();
+  else if (handler == HANDLER_JALR)
+    do_jalr();
+  else if (handler == HANDLER_MUL)
+    do_mul();
+  else if (handler == HANDLER_ADD)
+    do_add();
+  else if (handler == HANDLER_SUB)
+    do_sub();
+  else if (handler == HANDLER_BEQ)
+    do_beq();
+  else if (handler == HANDLER_SLTU)
+    do_sltu();
+  else if (handler == HANDLER_DIVU)
+    do_divu();
+  else if (handler == HANDLER_REMU)
+    do_remu();
+  else if (handler == HANDLER_ECALL)
+    do_ecall();
+  else if (handler == HANDLER_LUI)
+    do_lui();
+  else if (handler != HANDLER_NONE)
+    // nothing is executed after a faulting fetch
+    throw_exception(EXCEPTION_UNKNOWNINSTRUCTION, 0);
+}
 
-    printf3((uint32_t*) ",%d(%.2d%%)@%x", (uint32_t*) c, (uint32_t*) fixed_point_percentage(fixed_point_ratio(total, c, 4), 4), (uint32_t*) a);
-    print_code_line_number_for_instruction(a);
+void execute_counted_handler(uint32_t handler) {
+  // aggregate profiling counts instructions but not per instruction,
+  // which only concerns lw, sw, and jal
+  if (handler == HANDLER_LW) {
+    execute_uncounted_handler(handler);
 
-    return c;
-  } else {
-    print((uint32_t*) ",0(0.00%)");
+    if (trap == 0)
+      ic_lw = ic_lw + 1;
+  } else if (handler == HANDLER_SW) {
+    execute_uncounted_handler(handler);
 
-    return 0;
-  }
-}
+    if (trap == 0)
+      ic_sw = ic_sw + 1;
+  } else if (handler == HANDLER_JAL) {
+    execute_uncounted_handler(handler);
 
-void print_per_instruction_profile(uint32_t* message, uint32_t total, uint32_t* counters) {
-  printf3((uint32_t*) "%s%s%d", selfie_name, message, (uint32_t*) total);
-  print_per_instruction_counter(total, counters, print_per_instruction_counter(total, counters, print_per_instruction_counter(total, counters, UINT32_MAX)));
-  println();
+    ic_jal = ic_jal + 1;
+  } else
+    execute_handler(handler);
 }
 
-void print_profile() {
-  printf4((uint32_t*)
-    "%s: summary: %d executed instructions and %.2dMB(%.2d%%) mapped memory\n",
-    selfie_name,
-    (uint32_t*) get_total_number_of_instructions(),
-    (uint32_t*) fixed_point_ratio(pused(), MEGABYTE, 2),
-    (uint32_t*) fixed_point_percentage(fixed_point_ratio(page_frame_memory, pused(), 4), 4));
+void execute_uncounted_handler(uint32_t handler) {
+  uint32_t vaddr;
+  uint32_t* paddr;
 
-  if (get_total_number_of_instructions() > 0) {
-    print_instruction_counters();
+  // instructions without any profiling, faulting loads and
+  // stores fall back to their handlers for throwing exceptions
 
-    if (code_line_number != (uint32_t*) 0)
-      printf1((uint32_t*) "%s: profile: total,max(ratio%%)@addr(line#),2max,3max\n", selfie_name);
-    else
-      printf1((uint32_t*) "%s: profile: total,max(ratio%%)@addr,2max,3max\n", selfie_name);
+  if (handler == HANDLER_ADDI) {
+    if (rd != REG_ZR)
+      *(registers + rd) = *(registers + rs1) + imm;
 
-    print_per_instruction_profile((uint32_t*) ": calls:   ", calls, calls_per_procedure);
-    print_per_instruction_profile((uint32_t*) ": loops:   ", iterations, iterations_per_loop);
-    print_per_instruction_profile((uint32_t*) ": loads:   ", ic_lw, loads_per_instruction);
-    print_per_instruction_profile((uint32_t*) ": stores:  ", ic_sw, stores_per_instruction);
-  }
-}
+    pc = pc + INSTRUCTIONSIZE;
+  } else if (handler == HANDLER_LW) {
+    paddr = lookup_tlb(stlb, pt, *(registers + rs1) + imm);
 
-void selfie_disassemble(uint32_t verbose) {
-  uint32_t data;
+    if (paddr != (uint32_t*) 0) {
+      if (rd != REG_ZR)
+        *(registers + rd) = load_physical_memory(paddr);
 
-  assembly_name = get_argument();
+      pc = pc + INSTRUCTIONSIZE;
+    } else
+      do_lw();
+  } else if (handler == HANDLER_SW) {
+    vaddr = *(registers + rs1) + imm;
+    paddr = lookup_writable_tlb(stlb, pt, vaddr);
 
-  if (code_length == 0) {
-    printf2((uint32_t*) "%s: nothing to disassemble to output file %s\n", selfie_name, assembly_name);
+    if (paddr != (uint32_t*) 0) {
+      store_physical_memory(paddr, *(registers + rs2));
 
-    return;
-  }
+      if (vaddr - entry_point < code_length)
+        invalidate_decoded_instructions(current_context, vaddr, REGISTERSIZE);
 
-  // assert: assembly_name is mapped and not longer than MAX_FILENAME_LENGTH
+      pc = pc + INSTRUCTIONSIZE;
+    } else
+      do_sw();
+  } else if (handler == HANDLER_JAL) {
+    if (rd != REG_ZR)
+      *(registers + rd) = pc + INSTRUCTIONSIZE;
 
-  assembly_fd = open_write_only(assembly_name);
+    pc = pc + imm;
+  } else if (handler == HANDLER_BEQ) {
+    if (*(registers + rs1) == *(registers + rs2))
+      pc = pc + imm;
+    else
+      pc = pc + INSTRUCTIONSIZE;
+  } else if (handler == HANDLER_SLTU) {
+    if (rd != REG_ZR) {
+      if (*(registers + rs1) < *(registers + rs2))
+        *(registers + rd) = 1;
+      else
+        *(registers + rd) = 0;
+    }
 
-  if (signed_less_than(assembly_fd, 0)) {
-    printf2((uint32_t*) "%s: could not create assembly output file %s\n", selfie_name, assembly_name);
+    pc = pc + INSTRUCTIONSIZE;
+  } else if (handler == HANDLER_JALR) {
+    // prepare jump with LSB reset before linking, just in case rd == rs1
+    vaddr = left_shift(right_shift(*(registers + rs1) + imm, 1), 1);
 
-    exit(EXITCODE_IOERROR);
-  }
+    if (rd != REG_ZR)
+      *(registers + rd) = pc + INSTRUCTIONSIZE;
 
-  output_name = assembly_name;
-  output_fd   = assembly_fd;
+    pc = vaddr;
+  } else if (handler == HANDLER_ADD) {
+    if (rd != REG_ZR)
+      *(registers + rd) = *(registers + rs1) + *(registers + rs2);
 
-  execute = 0;
+    pc = pc + INSTRUCTIONSIZE;
+  } else if (handler == HANDLER_SUB) {
+    if (rd != REG_ZR)
+      *(registers + rd) = *(registers + rs1) - *(registers + rs2);
 
-  reset_library();
-  reset_interpreter();
+    pc = pc + INSTRUCTIONSIZE;
+  } else if (handler == HANDLER_MUL) {
+    if (rd != REG_ZR)
+      *(registers + rd) = *(registers + rs1) * *(registers + rs2);
 
-  debug               = 1;
-  disassemble         = 1;
-  disassemble_verbose = verbose;
+    pc = pc + INSTRUCTIONSIZE;
+  } else if (handler == HANDLER_DIVU) {
+    if (*(registers + rs2) != 0) {
+      if (rd != REG_ZR)
+        *(registers + rd) = *(registers + rs1) / *(registers + rs2);
 
-  while (pc < code_length) {
-    ir = load_instruction(pc);
+      pc = pc + INSTRUCTIONSIZE;
+    } else
+      throw_exception(EXCEPTION_DIVISIONBYZERO, 0);
+  } else if (handler == HANDLER_REMU) {
+    if (*(registers + rs2) != 0) {
+      if (rd != REG_ZR)
+        *(registers + rd) = *(registers + rs1) % *(registers + rs2);
 
-    decode_execute();
+      pc = pc + INSTRUCTIONSIZE;
+    } else
+      throw_exception(EXCEPTION_DIVISIONBYZERO, 0);
+  } else if (handler == HANDLER_LUI) {
+    if (rd != REG_ZR)
+      *(registers + rd) = left_shift(imm, 12);
 
     pc = pc + INSTRUCTIONSIZE;
-  }
+  } else if (handler == HANDLER_ECALL)
+    execute_ecall();
+  else if (handler != HANDLER_NONE)
+    throw_exception(EXCEPTION_UNKNOWNINSTRUCTION, 0);
+}
+
+void fuse_decoded_instructions(uint32_t* entry, uint32_t vaddr) {
+  uint32_t* previous;
+
+  // look for idioms of starc that end in the instruction just decoded
+  // at vaddr and mark their first instruction as superinstruction;
+  // all instructions of a superinstruction remain individually decoded
+  // for jumps into the middle of superinstructions
+
+  if (vaddr - entry_point < INSTRUCTIONSIZE)
+    return;
+
+  previous = entry - DECODEDINSTRUCTIONSIZE;
+
+  if (*entry == HANDLER_SW) {
+    if (*(entry + 1) == REG_SP)
+      if (*(entry + 4) == 0)
+        if (*previous == HANDLER_ADDI)
+          if (*(previous + 3) == REG_SP)
+            if (*(previous + 1) == REG_SP)
+              if (*(previous + 4) == -REGISTERSIZE)
+                // push of save_temporaries and procedure prologues
+                *(previous + 7) = HANDLER_PUSH;
+  } else if (*entry == HANDLER_ADDI) {
+    if (*previous == HANDLER_LW) {
+      if (*(entry + 3) == REG_SP)
+        if (*(entry + 1) == REG_SP)
+          if (*(entry + 4) == REGISTERSIZE)
+            if (*(previous + 1) == REG_SP)
+              if (*(previous + 4) == 0)
+                // pop of restore_temporaries and procedure epilogues
+                *(previous + 7) = HANDLER_POP;
+    } else if (*previous == HANDLER_LUI)
+      if (*(entry + 1) == *(previous + 3))
+        if (*(entry + 3) == *(previous + 3))
+          // load_integer of large integers
+          *(previous + 7) = HANDLER_LI;
+  } else if (*entry == HANDLER_BEQ) {
+    if (*previous == HANDLER_SLTU)
+      if (*(entry + 1) == *(previous + 3))
+        if (*(entry + 2) == REG_ZR) {
+          // comparison followed by conditional branch of if and while
+          *(previous + 7) = HANDLER_SLTU_BEQ;
+
+          if (vaddr - entry_point >= 3 * INSTRUCTIONSIZE)
+            if (*(previous - DECODEDINSTRUCTIONSIZE) == HANDLER_ADDI)
+              if (*(previous - 2 * DECODEDINSTRUCTIONSIZE) == HANDLER_SUB)
+                // a == b iff unsigned b - a < 1
+                *(previous - 2 * DECODEDINSTRUCTIONSIZE + 7) = HANDLER_EQUAL_BEQ;
+        }
+  }
+}
+
+uint32_t superinstruction_length(uint32_t handler) {
+  if (handler == HANDLER_EQUAL_BEQ)
+    return 4;
+  else
+    return 2;
+}
+
+void load_next_instruction() {
+  uint32_t* entry;
+
+  // assert: instruction at pc is in decoded instruction cache
+  entry = decoded_instruction(dcache, dcache_length, pc);
+
+  rs1 = *(entry + 1);
+  rs2 = *(entry + 2);
+  rd  = *(entry + 3);
+  imm = *(entry + 4);
+}
+
+void execute_superinstruction(uint32_t handler) {
+  uint32_t* entry;
+  uint32_t* next;
+  uint32_t* paddr;
+  uint32_t a;
+  uint32_t n;
+
+  // assert: timer == TIMEROFF or timer > superinstruction_length(handler)
+
+  // instructions have the exact same semantics, counters, and
+  // exceptions as without fusion but are dispatched only once and
+  // with only one timer update in total, faulting loads and stores
+  // fall back to their handlers for throwing exceptions
+
+  entry = decoded_instruction(dcache, dcache_length, pc);
+  next  = entry + DECODEDINSTRUCTIONSIZE;
+
+  n = superinstruction_length(handler);
+
+  if (handler == HANDLER_PUSH) {
+    paddr = lookup_writable_tlb(stlb, pt, *(registers + REG_SP) - REGISTERSIZE);
+
+    if (paddr != (uint32_t*) 0) {
+      *(registers + REG_SP) = *(registers + REG_SP) - REGISTERSIZE;
+
+      store_physical_memory(paddr, *(registers + *(next + 2)));
+
+      if (*(registers + REG_SP) - entry_point < code_length)
+        invalidate_decoded_instructions(current_context, *(registers + REG_SP), REGISTERSIZE);
+
+      a = (pc - entry_point) / INSTRUCTIONSIZE + 1;
+
+      *(stores_per_instruction + a) = *(stores_per_instruction + a) + 1;
+
+      pc = pc + 2 * INSTRUCTIONSIZE;
+
+      ic_addi = ic_addi + 1;
+      ic_sw   = ic_sw + 1;
+    } else {
+      do_addi();
+      load_next_instruction();
+      do_sw();
+    }
+  } else if (handler == HANDLER_POP) {
+    paddr = lookup_tlb(stlb, pt, *(registers + REG_SP));
+
+    if (paddr != (uint32_t*) 0) {
+      if (rd != REG_ZR)
+        *(registers + rd) = load_physical_memory(paddr);
+
+      *(registers + REG_SP) = *(registers + REG_SP) + REGISTERSIZE;
+
+      a = (pc - entry_point) / INSTRUCTIONSIZE;
+
+      *(loads_per_instruction + a) = *(loads_per_instruction + a) + 1;
+
+      pc = pc + 2 * INSTRUCTIONSIZE;
+
+      ic_lw   = ic_lw + 1;
+      ic_addi = ic_addi + 1;
+    } else {
+      // addi is not executed if lw faults
+      do_lw();
+
+      n = 1;
+    }
+  } else if (handler == HANDLER_LI) {
+    if (rd != REG_ZR)
+      *(registers + rd) = left_shift(imm, 12) + *(next + 4);
+
+    pc = pc + 2 * INSTRUCTIONSIZE;
+
+    ic_lui  = ic_lui + 1;
+    ic_addi = ic_addi + 1;
+  } else if (handler == HANDLER_SLTU_BEQ) {
+    if (rd != REG_ZR) {
+      if (*(registers + rs1) < *(registers + rs2))
+        *(registers + rd) = 1;
+      else
+        *(registers + rd) = 0;
+    }
+
+    if (*(registers + rd) == 0)
+      pc = pc + INSTRUCTIONSIZE + *(next + 4);
+    else
+      pc = pc + 2 * INSTRUCTIONSIZE;
+
+    ic_sltu = ic_sltu + 1;
+    ic_beq  = ic_beq + 1;
+  } else if (handler == HANDLER_EQUAL_BEQ) {
+    do_sub();
+    load_next_instruction();
+    do_addi();
+    load_next_instruction();
+    do_sltu();
+    load_next_instruction();
+    do_beq();
+  }
+
+  // timer does not expire since timer > n
+  if (timer != TIMEROFF)
+    timer = timer - n;
+}
+
+void execute_counted_superinstruction(uint32_t handler) {
+  // aggregate profiling counts instructions but not per instruction
+  execute_uncounted_superinstruction(handler);
+
+  if (trap == 0) {
+    if (handler == HANDLER_PUSH) {
+      ic_addi = ic_addi + 1;
+      ic_sw   = ic_sw + 1;
+    } else if (handler == HANDLER_POP) {
+      ic_lw   = ic_lw + 1;
+      ic_addi = ic_addi + 1;
+    } else if (handler == HANDLER_LI) {
+      ic_lui  = ic_lui + 1;
+      ic_addi = ic_addi + 1;
+    } else if (handler == HANDLER_SLTU_BEQ) {
+      ic_sltu = ic_sltu + 1;
+      ic_beq  = ic_beq + 1;
+    } else if (handler == HANDLER_EQUAL_BEQ) {
+      ic_sub  = ic_sub + 1;
+      ic_addi = ic_addi + 1;
+      ic_sltu = ic_sltu + 1;
+      ic_beq  = ic_beq + 1;
+    }
+  } else if (handler == HANDLER_PUSH)
+    // addi is executed even if sw faults
+    ic_addi = ic_addi + 1;
+}
+
+void execute_uncounted_superinstruction(uint32_t handler) {
+  uint32_t* entry;
+  uint32_t* next;
+  uint32_t* paddr;
+  uint32_t n;
+
+  // assert: timer == TIMEROFF or timer > superinstruction_length(handler)
+
+  // same as execute_superinstruction without any profiling
+
+  entry = decoded_instruction(dcache, dcache_length, pc);
+  next  = entry + DECODEDINSTRUCTIONSIZE;
+
+  n = superinstruction_length(handler);
+
+  if (handler == HANDLER_PUSH) {
+    paddr = lookup_writable_tlb(stlb, pt, *(registers + REG_SP) - REGISTERSIZE);
+
+    if (paddr != (uint32_t*) 0) {
+      *(registers + REG_SP) = *(registers + REG_SP) - REGISTERSIZE;
+
+      store_physical_memory(paddr, *(registers + *(next + 2)));
+
+      if (*(registers + REG_SP) - entry_point < code_length)
+        invalidate_decoded_instructions(current_context, *(registers + REG_SP), REGISTERSIZE);
+
+      pc = pc + 2 * INSTRUCTIONSIZE;
+    } else {
+      execute_uncounted_handler(HANDLER_ADDI);
+      load_next_instruction();
+      execute_uncounted_handler(HANDLER_SW);
+    }
+  } else if (handler == HANDLER_POP) {
+    paddr = lookup_tlb(stlb, pt, *(registers + REG_SP));
+
+    if (paddr != (uint32_t*) 0) {
+      if (rd != REG_ZR)
+        *(registers + rd) = load_physical_memory(paddr);
+
+      *(registers + REG_SP) = *(registers + REG_SP) + REGISTERSIZE;
+
+      pc = pc + 2 * INSTRUCTIONSIZE;
+    } else {
+      // addi is not executed if lw faults
+      execute_uncounted_handler(HANDLER_LW);
+
+      n = 1;
+    }
+  } else if (handler == HANDLER_LI) {
+    if (rd != REG_ZR)
+      *(registers + rd) = left_shift(imm, 12) + *(next + 4);
+
+    pc = pc + 2 * INSTRUCTIONSIZE;
+  } else if (handler == HANDLER_SLTU_BEQ) {
+    if (rd != REG_ZR) {
+      if (*(registers + rs1) < *(registers + rs2))
+        *(registers + rd) = 1;
+      else
+        *(registers + rd) = 0;
+    }
+
+    if (*(registers + rd) == 0)
+      pc = pc + INSTRUCTIONSIZE + *(next + 4);
+    else
+      pc = pc + 2 * INSTRUCTIONSIZE;
+  } else if (handler == HANDLER_EQUAL_BEQ) {
+    execute_uncounted_handler(HANDLER_SUB);
+    load_next_instruction();
+    execute_uncounted_handler(HANDLER_ADDI);
+    load_next_instruction();
+    execute_uncounted_handler(HANDLER_SLTU);
+    load_next_instruction();
+    execute_uncounted_handler(HANDLER_BEQ);
+  }
+
+  // timer does not expire since timer > n
+  if (timer != TIMEROFF)
+    timer = timer - n;
+}
+
+uint32_t is_control_transfer(uint32_t handler) {
+  if (handler == HANDLER_JAL)
+    return 1;
+  else if (handler == HANDLER_JALR)
+    return 1;
+  else if (handler == HANDLER_BEQ)
+    return 1;
+  else
+    return 0;
+}
+
+void translate_hot_code(uint32_t from) {
+  uint32_t* entry;
+  uint32_t n;
+  uint32_t length;
+
+  // translate all decoded instructions from the first instruction of
+  // a hot loop or procedure at from to the end of the procedure into
+  // blocks where each block runs straight to the next control transfer;
+  // with blocks starting at every instruction there is a block for
+  // every jump target and no block ever needs to be split
+
+  entry = decoded_instruction(dcache, dcache_length, from);
+
+  n = 0;
+
+  // procedures end with the jalr of their epilogue
+  while (*entry != HANDLER_JALR) {
+    if (*entry == HANDLER_NONE)
+      // instructions not yet decoded end translation
+      return;
+
+    entry = entry + DECODEDINSTRUCTIONSIZE;
+
+    n = n + 1;
+
+    if (from + n * INSTRUCTIONSIZE - entry_point >= code_length)
+      return;
+  }
+
+  length = 0;
+
+  // walk backwards to count instructions to the next control transfer
+  while (n + 1 > 0) {
+    if (*entry == HANDLER_NONE)
+      length = 0;
+    else if (*entry == HANDLER_ECALL)
+      // system calls always leave blocks through the interpreter
+      length = 0;
+    else if (*entry == HANDLER_UNKNOWN)
+      length = 0;
+    else if (is_control_transfer(*entry))
+      length = 1;
+    else
+      length = length + 1;
+
+    *(entry + 5) = length;
+
+    entry = entry - DECODEDINSTRUCTIONSIZE;
+
+    if (n == 0)
+      return;
+
+    n = n - 1;
+  }
+}
+
+void count_hot_code() {
+  uint32_t* entry;
+
+  // assert: jal just executed, pc is first instruction of procedure or loop
+  entry = decoded_instruction(dcache, dcache_length, pc);
+
+  if (entry != (uint32_t*) 0) {
+    *(entry + 6) = *(entry + 6) + 1;
+
+    if (*(entry + 6) == HOTCODE)
+      translate_hot_code(pc);
+  }
+}
+
+uint32_t execute_block(uint32_t* entry) {
+  uint32_t length;
+  uint32_t handler;
+  uint32_t n;
+  uint32_t a;
+  uint32_t vaddr;
+  uint32_t* paddr;
+
+  length = *(entry + 5);
+
+  // instruction address for profiling loads and stores
+  a = (pc - entry_point) / INSTRUCTIONSIZE;
+
+  n = 0;
+
+  while (n < length) {
+    handler = *entry;
+
+    if (handler == HANDLER_NONE)
+      // stores into the block invalidate the rest of the block
+      return n;
+
+    rs1 = *(entry + 1);
+    rs2 = *(entry + 2);
+    rd  = *(entry + 3);
+    imm = *(entry + 4);
+
+    // addi, lw, and sw make up 80% of all executed instructions
+    // and are thus inlined in blocks unless loads and stores fault
+
+    if (handler == HANDLER_ADDI) {
+      if (rd != REG_ZR)
+        *(registers + rd) = *(registers + rs1) + imm;
+
+      pc = pc + INSTRUCTIONSIZE;
+
+      ic_addi = ic_addi + 1;
+    } else if (handler == HANDLER_LW) {
+      paddr = lookup_tlb(stlb, pt, *(registers + rs1) + imm);
+
+      if (paddr != (uint32_t*) 0) {
+        if (rd != REG_ZR)
+          *(registers + rd) = load_physical_memory(paddr);
+
+        pc = pc + INSTRUCTIONSIZE;
+
+        ic_lw = ic_lw + 1;
+
+        *(loads_per_instruction + a) = *(loads_per_instruction + a) + 1;
+      } else
+        do_lw();
+    } else if (handler == HANDLER_SW) {
+      vaddr = *(registers + rs1) + imm;
+      paddr = lookup_writable_tlb(stlb, pt, vaddr);
+
+      if (paddr != (uint32_t*) 0) {
+        store_physical_memory(paddr, *(registers + rs2));
+
+        if (vaddr - entry_point < code_length)
+          invalidate_decoded_instructions(current_context, vaddr, REGISTERSIZE);
+
+        pc = pc + INSTRUCTIONSIZE;
+
+        ic_sw = ic_sw + 1;
+
+        *(stores_per_instruction + a) = *(stores_per_instruction + a) + 1;
+      } else
+        do_sw();
+    } else {
+      execute_handler(handler);
+
+      if (trap)
+        // exceptions leave the block right after the faulting instruction
+        return n + 1;
+      else if (is_control_transfer(handler))
+        // instructions may have been decoded again after translation
+        return n + 1;
+    }
+
+    n = n + 1;
+
+    if (trap)
+      return n;
+
+    entry = entry + DECODEDINSTRUCTIONSIZE;
+
+    a = a + 1;
+  }
+
+  return n;
+}
+
+uint32_t execute_counted_block(uint32_t* entry) {
+  uint32_t length;
+  uint32_t handler;
+  uint32_t n;
+  uint32_t vaddr;
+  uint32_t* paddr;
+
+  length = *(entry + 5);
+
+  // same as execute_block with aggregate profiling only
+
+  n = 0;
+
+  while (n < length) {
+    handler = *entry;
+
+    if (handler == HANDLER_NONE)
+      // stores into the block invalidate the rest of the block
+      return n;
+
+    rs1 = *(entry + 1);
+    rs2 = *(entry + 2);
+    rd  = *(entry + 3);
+    imm = *(entry + 4);
+
+    if (handler == HANDLER_ADDI) {
+      if (rd != REG_ZR)
+        *(registers + rd) = *(registers + rs1) + imm;
+
+      pc = pc + INSTRUCTIONSIZE;
+
+      ic_addi = ic_addi + 1;
+    } else if (handler == HANDLER_LW) {
+      paddr = lookup_tlb(stlb, pt, *(registers + rs1) + imm);
+
+      if (paddr != (uint32_t*) 0) {
+        if (rd != REG_ZR)
+          *(registers + rd) = load_physical_memory(paddr);
+
+        pc = pc + INSTRUCTIONSIZE;
+
+        ic_lw = ic_lw + 1;
+      } else
+        do_lw();
+    } else if (handler == HANDLER_SW) {
+      vaddr = *(registers + rs1) + imm;
+      paddr = lookup_writable_tlb(stlb, pt, vaddr);
+
+      if (paddr != (uint32_t*) 0) {
+        store_physical_memory(paddr, *(registers + rs2));
+
+        if (vaddr - entry_point < code_length)
+          invalidate_decoded_instructions(current_context, vaddr, REGISTERSIZE);
+
+        pc = pc + INSTRUCTIONSIZE;
+
+        ic_sw = ic_sw + 1;
+      } else
+        do_sw();
+    } else {
+      execute_counted_handler(handler);
+
+      if (trap)
+        // exceptions leave the block right after the faulting instruction
+        return n + 1;
+      else if (is_control_transfer(handler))
+        // instructions may have been decoded again after translation
+        return n + 1;
+    }
+
+    n = n + 1;
+
+    if (trap)
+      return n;
+
+    entry = entry + DECODEDINSTRUCTIONSIZE;
+  }
+
+  return n;
+}
+
+uint32_t execute_uncounted_block(uint32_t* entry) {
+  uint32_t length;
+  uint32_t handler;
+  uint32_t n;
+  uint32_t vaddr;
+  uint32_t* paddr;
+
+  length = *(entry + 5);
+
+  // same as execute_block without any profiling
+
+  n = 0;
+
+  while (n < length) {
+    handler = *entry;
+
+    if (handler == HANDLER_NONE)
+      // stores into the block invalidate the rest of the block
+      return n;
+
+    rs1 = *(entry + 1);
+    rs2 = *(entry + 2);
+    rd  = *(entry + 3);
+    imm = *(entry + 4);
+
+    if (handler == HANDLER_ADDI) {
+      if (rd != REG_ZR)
+        *(registers + rd) = *(registers + rs1) + imm;
+
+      pc = pc + INSTRUCTIONSIZE;
+    } else if (handler == HANDLER_LW) {
+      paddr = lookup_tlb(stlb, pt, *(registers + rs1) + imm);
+
+      if (paddr != (uint32_t*) 0) {
+        if (rd != REG_ZR)
+          *(registers + rd) = load_physical_memory(paddr);
+
+        pc = pc + INSTRUCTIONSIZE;
+      } else
+        do_lw();
+    } else if (handler == HANDLER_SW) {
+      vaddr = *(registers + rs1) + imm;
+      paddr = lookup_writable_tlb(stlb, pt, vaddr);
+
+      if (paddr != (uint32_t*) 0) {
+        store_physical_memory(paddr, *(registers + rs2));
+
+        if (vaddr - entry_point < code_length)
+          invalidate_decoded_instructions(current_context, vaddr, REGISTERSIZE);
+
+        pc = pc + INSTRUCTIONSIZE;
+      } else
+        do_sw();
+    } else {
+      execute_uncounted_handler(handler);
+
+      if (trap)
+        // exceptions leave the block right after the faulting instruction
+        return n + 1;
+      else if (is_control_transfer(handler))
+        // instructions may have been decoded again after translation
+        return n + 1;
+    }
+
+    n = n + 1;
+
+    if (trap)
+      return n;
+
+    entry = entry + DECODEDINSTRUCTIONSIZE;
+  }
+
+  return n;
+}
+
+void interrupt() {
+  if (timer != TIMEROFF) {
+    timer = timer - 1;
+
+    if (timer == 0) {
+      if (get_exception(current_context) == EXCEPTION_NOEXCEPTION)
+        // only throw exception if no other is pending
+        // TODO: handle multiple pending exceptions
+        throw_exception(EXCEPTION_TIMER, 0);
+      else
+        // trigger timer in the next interrupt cycle
+        timer = 1;
+    }
+  }
+}
+
+void run_basic_blocks() {
+  uint32_t start;
+  uint32_t handler;
+
+  // assert: timer == TIMEROFF or timer > MAX_BLOCK_LENGTH
+
+  // the timer cannot expire in a basic block before reaching its
+  // control transfer, so straight-line instructions are charged to
+  // the timer as a whole at the end of their block, computed from
+  // the distance to the start of the block
+
+  start   = pc;
+  handler = HANDLER_NONE;
+
+  while (trap == 0) {
+    handler = fetch_decode();
+
+    if (handler < HANDLER_JAL)
+      // straight-line instruction
+      execute_handler(handler);
+    else {
+      if (timer != TIMEROFF)
+        timer = timer - (pc - start) / INSTRUCTIONSIZE;
+
+      if (handler >= HANDLER_PUSH)
+        execute_superinstruction(handler);
+      else {
+        execute_handler(handler);
+
+        interrupt();
+      }
+
+      start = pc;
+
+      if (timer != TIMEROFF)
+        if (timer <= MAX_BLOCK_LENGTH)
+          // timer may expire in next block
+          return;
+    }
+  }
+
+  if (handler < HANDLER_JAL)
+    // faulting straight-line instruction is charged as well
+    if (timer != TIMEROFF)
+      timer = timer - (pc - start) / INSTRUCTIONSIZE - 1;
+}
+
+void run_counted_basic_blocks() {
+  uint32_t start;
+  uint32_t handler;
+
+  // same as run_basic_blocks with aggregate profiling only
+
+  start   = pc;
+  handler = HANDLER_NONE;
+
+  while (trap == 0) {
+    handler = fetch_decode();
+
+    if (handler < HANDLER_JAL)
+      // straight-line instruction
+      execute_counted_handler(handler);
+    else {
+      if (timer != TIMEROFF)
+        timer = timer - (pc - start) / INSTRUCTIONSIZE;
+
+      if (handler >= HANDLER_PUSH)
+        execute_counted_superinstruction(handler);
+      else {
+        execute_counted_handler(handler);
+
+        interrupt();
+      }
+
+      start = pc;
+
+      if (timer != TIMEROFF)
+        if (timer <= MAX_BLOCK_LENGTH)
+          // timer may expire in next block
+          return;
+    }
+  }
+
+  if (handler < HANDLER_JAL)
+    // faulting straight-line instruction is charged as well
+    if (timer != TIMEROFF)
+      timer = timer - (pc - start) / INSTRUCTIONSIZE - 1;
+}
+
+void run_uncounted_basic_blocks() {
+  uint32_t start;
+  uint32_t handler;
+
+  // same as run_basic_blocks without any profiling
+
+  start   = pc;
+  handler = HANDLER_NONE;
+
+  while (trap == 0) {
+    handler = fetch_decode();
+
+    if (handler < HANDLER_JAL)
+      // straight-line instruction
+      execute_uncounted_handler(handler);
+    else {
+      if (timer != TIMEROFF)
+        timer = timer - (pc - start) / INSTRUCTIONSIZE;
+
+      if (handler >= HANDLER_PUSH)
+        execute_uncounted_superinstruction(handler);
+      else {
+        execute_uncounted_handler(handler);
+
+        interrupt();
+      }
+
+      start = pc;
+
+      if (timer != TIMEROFF)
+        if (timer <= MAX_BLOCK_LENGTH)
+          // timer may expire in next block
+          return;
+    }
+  }
+
+  if (handler < HANDLER_JAL)
+    // faulting straight-line instruction is charged as well
+    if (timer != TIMEROFF)
+      timer = timer - (pc - start) / INSTRUCTIONSIZE - 1;
+}
+
+void run_fast_engine() {
+  uint32_t handler;
+
+  // dispatching decoded instructions with full profiling
+
+  while (trap == 0)
+    if (timer == TIMEROFF)
+      run_basic_blocks();
+    else if (timer > MAX_BLOCK_LENGTH)
+      run_basic_blocks();
+    else {
+      // timer may expire before the end of the current basic block:
+      // single-step for precise interrupt
+      handler = fetch_decode();
+
+      if (handler >= HANDLER_PUSH)
+        execute_superinstruction(handler);
+      else {
+        execute_handler(handler);
+
+        interrupt();
+      }
+    }
+}
+
+void run_counted_fast_engine() {
+  uint32_t handler;
+
+  // same as run_fast_engine with aggregate profiling only
+
+  while (trap == 0)
+    if (timer == TIMEROFF)
+      run_counted_basic_blocks();
+    else if (timer > MAX_BLOCK_LENGTH)
+      run_counted_basic_blocks();
+    else {
+      // timer may expire before the end of the current basic block:
+      // single-step for precise interrupt
+      handler = fetch_decode();
+
+      if (handler >= HANDLER_PUSH)
+        execute_counted_superinstruction(handler);
+      else {
+        execute_counted_handler(handler);
+
+        interrupt();
+      }
+    }
+}
+
+void run_uncounted_fast_engine() {
+  uint32_t handler;
+
+  // same as run_fast_engine without any profiling
+
+  while (trap == 0)
+    if (timer == TIMEROFF)
+      run_uncounted_basic_blocks();
+    else if (timer > MAX_BLOCK_LENGTH)
+      run_uncounted_basic_blocks();
+    else {
+      // timer may expire before the end of the current basic block:
+      // single-step for precise interrupt
+      handler = fetch_decode();
+
+      if (handler >= HANDLER_PUSH)
+        execute_uncounted_superinstruction(handler);
+      else {
+        execute_uncounted_handler(handler);
+
+        interrupt();
+      }
+    }
+}
+
+void run_block_engine() {
+  uint32_t handler;
+  uint32_t* entry;
+  uint32_t length;
+
+  // executing translated hot blocks as a whole with full profiling
+
+  while (trap == 0) {
+    entry = decoded_instruction(dcache, dcache_length, pc);
+
+    length = 0;
+
+    if (entry != (uint32_t*) 0)
+      length = *(entry + 5);
+
+    if (length == 0)
+      // not in a translated block
+      entry = (uint32_t*) 0;
+    else if (timer != TIMEROFF)
+      if (timer <= length)
+        // timer may expire in block: single-step for precise interrupt
+        entry = (uint32_t*) 0;
+
+    if (entry != (uint32_t*) 0) {
+      length = execute_block(entry);
+
+      // timer does not expire in block since timer > length
+      if (timer != TIMEROFF)
+        timer = timer - length;
+    } else {
+      handler = fetch_decode();
+
+      if (handler >= HANDLER_PUSH)
+        execute_superinstruction(handler);
+      else {
+        execute_handler(handler);
+
+        if (handler == HANDLER_JAL) {
+          if (rd != REG_ZR)
+            // procedure call
+            count_hot_code();
+          else if (signed_less_than(imm, 0))
+            // loop iteration
+            count_hot_code();
+        }
+
+        interrupt();
+      }
+    }
+  }
+}
+
+void run_counted_block_engine() {
+  uint32_t handler;
+  uint32_t* entry;
+  uint32_t length;
+
+  // same as run_block_engine with aggregate profiling only
+
+  while (trap == 0) {
+    entry = decoded_instruction(dcache, dcache_length, pc);
+
+    length = 0;
+
+    if (entry != (uint32_t*) 0)
+      length = *(entry + 5);
+
+    if (length == 0)
+      // not in a translated block
+      entry = (uint32_t*) 0;
+    else if (timer != TIMEROFF)
+      if (timer <= length)
+        // timer may expire in block: single-step for precise interrupt
+        entry = (uint32_t*) 0;
+
+    if (entry != (uint32_t*) 0) {
+      length = execute_counted_block(entry);
+
+      // timer does not expire in block since timer > length
+      if (timer != TIMEROFF)
+        timer = timer - length;
+    } else {
+      handler = fetch_decode();
+
+      if (handler >= HANDLER_PUSH)
+        execute_counted_superinstruction(handler);
+      else {
+        execute_counted_handler(handler);
+
+        if (handler == HANDLER_JAL) {
+          if (rd != REG_ZR)
+            // procedure call
+            count_hot_code();
+          else if (signed_less_than(imm, 0))
+            // loop iteration
+            count_hot_code();
+        }
+
+        interrupt();
+      }
+    }
+  }
+}
+
+void run_uncounted_block_engine() {
+  uint32_t handler;
+  uint32_t* entry;
+  uint32_t length;
+
+  // same as run_block_engine without any profiling
+
+  while (trap == 0) {
+    entry = decoded_instruction(dcache, dcache_length, pc);
+
+    length = 0;
+
+    if (entry != (uint32_t*) 0)
+      length = *(entry + 5);
+
+    if (length == 0)
+      // not in a translated block
+      entry = (uint32_t*) 0;
+    else if (timer != TIMEROFF)
+      if (timer <= length)
+        // timer may expire in block: single-step for precise interrupt
+        entry = (uint32_t*) 0;
+
+    if (entry != (uint32_t*) 0) {
+      length = execute_uncounted_block(entry);
+
+      // timer does not expire in block since timer > length
+      if (timer != TIMEROFF)
+        timer = timer - length;
+    } else {
+      handler = fetch_decode();
+
+      if (handler >= HANDLER_PUSH)
+        execute_uncounted_superinstruction(handler);
+      else {
+        execute_uncounted_handler(handler);
+
+        if (handler == HANDLER_JAL) {
+          if (rd != REG_ZR)
+            // procedure call
+            count_hot_code();
+          else if (signed_less_than(imm, 0))
+            // loop iteration
+            count_hot_code();
+        }
+
+        interrupt();
+      }
+    }
+  }
+}
+
+uint32_t* run_until_exception() {
+  trap = 0;
+
+  // engines are chosen for the profiling level once
+  // rather than testing the level for each instruction
+
+  if (debug)
+    // reference engine for debugging, replaying, and symbolic execution
+    while (trap == 0) {
+      fetch();
+
+      if (trap == 0)
+        decode_execute();
+
+      interrupt();
+    }
+  else if (jit) {
+    // block engine executing translated hot blocks as a whole
+    if (profiling == PROFILE_FULL)
+      run_block_engine();
+    else if (profiling == PROFILE_AGGREGATE)
+      run_counted_block_engine();
+    else
+      run_uncounted_block_engine();
+  } else if (profiling == PROFILE_FULL)
+    // fast engine dispatching decoded instructions without any debugging checks
+    run_fast_engine();
+  else if (profiling == PROFILE_AGGREGATE)
+    run_counted_fast_engine();
+  else
+    run_uncounted_fast_engine();
+
+  trap = 0;
+
+  return current_context;
+}
+
+uint32_t instruction_with_max_counter(uint32_t* counters, uint32_t max) {
+  uint32_t a;
+  uint32_t n;
+  uint32_t i;
+  uint32_t c;
+
+  a = UINT32_MAX;
+
+  n = 0;
+  i = 0;
+
+  while (i < code_length / INSTRUCTIONSIZE) {
+    c = *(counters + i);
+
+    if (n < c) {
+      if (c < max) {
+        n = c;
+        a = i;
+      } else
+        return i * INSTRUCTIONSIZE;
+    }
+
+    i = i + 1;
+  }
+
+  if (a != UINT32_MAX)
+    return a * INSTRUCTIONSIZE;
+  else
+    return UINT32_MAX;
+}
+
+uint32_t print_per_instruction_counter(uint32_t total, uint32_t* counters, uint32_t max) {
+  uint32_t a;
+  uint32_t c;
+
+  a = instruction_with_max_counter(counters, max);
+
+  if (a != UINT32_MAX) {
+    c = *(counters + a / INSTRUCTIONSIZE);
+
+    // CAUTION: we reset counter to avoid reporting it again
+    *(counters + a / INSTRUCTIONSIZE) = 0;
+
+    printf3((uint32_t*) ",%d(%.2d%%)@%x", (uint32_t*) c, (uint32_t*) fixed_point_percentage(fixed_point_ratio(total, c, 4), 4), (uint32_t*) a);
+    print_code_line_number_for_instruction(a);
+
+    return c;
+  } else {
+    print((uint32_t*) ",0(0.00%)");
+
+    return 0;
+  }
+}
+
+void print_per_instruction_profile(uint32_t* message, uint32_t total, uint32_t* counters) {
+  printf3((uint32_t*) "%s%s%d", selfie_name, message, (uint32_t*) total);
+  print_per_instruction_counter(total, counters, print_per_instruction_counter(total, counters, print_per_instruction_counter(total, counters, UINT32_MAX)));
+  println();
+}
+
+void print_profile() {
+  if (profiling == PROFILE_NONE)
+    return;
+
+  printf4((uint32_t*)
+    "%s: summary: %d executed instructions and %.2dMB(%.2d%%) mapped memory\n",
+    selfie_name,
+    (uint32_t*) get_total_number_of_instructions(),
+    (uint32_t*) fixed_point_ratio(peak_page_frame_memory, MEGABYTE, 2),
+    (uint32_t*) fixed_point_percentage(fixed_point_ratio(page_frame_memory, peak_page_frame_memory, 4), 4));
+
+  if (page_outs > 0)
+    printf3((uint32_t*) "%s: swap: %d page-ins and %d page-outs\n", selfie_name, (uint32_t*) page_ins, (uint32_t*) page_outs);
+
+  if (debug_tlb)
+    printf4((uint32_t*) "%s: tlb: %d hits and %d misses (%.2d%% hit rate)\n",
+      selfie_name,
+      (uint32_t*) tlb_hits,
+      (uint32_t*) tlb_misses,
+      (uint32_t*) fixed_point_percentage(fixed_point_ratio(tlb_hits + tlb_misses, tlb_hits, 4), 4));
+
+  if (get_total_number_of_instructions() > 0) {
+    print_instruction_counters();
+
+    if (profiling == PROFILE_FULL) {
+      if (code_line_number != (uint32_t*) 0)
+        printf1((uint32_t*) "%s: profile: total,max(ratio%%)@addr(line#),2max,3max\n", selfie_name);
+      else
+        printf1((uint32_t*) "%s: profile: total,max(ratio%%)@addr,2max,3max\n", selfie_name);
+
+      print_per_instruction_profile((uint32_t*) ": calls:   ", calls, calls_per_procedure);
+      print_per_instruction_profile((uint32_t*) ": loops:   ", iterations, iterations_per_loop);
+      print_per_instruction_profile((uint32_t*) ": loads:   ", ic_lw, loads_per_instruction);
+      print_per_instruction_profile((uint32_t*) ": stores:  ", ic_sw, stores_per_instruction);
+    }
+  }
+}
+
+void selfie_disassemble(uint32_t verbose) {
+  uint32_t data;
+
+  assembly_name = get_argument();
+
+  if (code_length == 0) {
+    printf2((uint32_t*) "%s: nothing to disassemble to output file %s\n", selfie_name, assembly_name);
+
+    return;
+  }
+
+  // assert: assembly_name is mapped and not longer than MAX_FILENAME_LENGTH
+
+  assembly_fd = open_write_only(assembly_name);
+
+  if (signed_less_than(assembly_fd, 0)) {
+    printf2((uint32_t*) "%s: could not create assembly output file %s\n", selfie_name, assembly_name);
+
+    exit(EXITCODE_IOERROR);
+  }
+
+  output_name = assembly_name;
+  output_fd   = assembly_fd;
+
+  execute = 0;
+
+  reset_library();
+  reset_interpreter();
+
+  debug               = 1;
+  disassemble         = 1;
+  disassemble_verbose = verbose;
+
+  while (pc < code_length) {
+    ir = load_instruction(pc);
+
+    decode_execute();
+
+    pc = pc + INSTRUCTIONSIZE;
+  }
 
   while (pc < binary_length) {
     data = load_data(pc);
 
-    print_data(data);
-    println();
+    print_data(data);
+    println();
+
+    pc = pc + REGISTERSIZE;
+  }
+
+  disassemble_verbose = 0;
+  disassemble         = 0;
+  debug               = 0;
+
+  output_name = (uint32_t*) 0;
+  output_fd   = 1;
+
+  printf5((uint32_t*) "%s: %d characters of assembly with %d instructions and %d bytes of data written into %s\n", selfie_name,
+    (uint32_t*) number_of_written_characters,
+    (uint32_t*) (code_length / INSTRUCTIONSIZE),
+    (uint32_t*) (binary_length - code_length),
+    assembly_name);
+}
+
+// -----------------------------------------------------------------
+// -------------------------- TRANSLATOR ---------------------------
+// -----------------------------------------------------------------
+
+void find_leaders() {
+  uint32_t target;
+
+  // the first instruction of a basic block is its leader, here we
+  // only need leaders that are targets of branches, jumps, and calls;
+  // calls and jumps are recorded separately since only jump targets
+  // need labels which would otherwise be unused in C
+
+  leaders = zalloc(code_length / INSTRUCTIONSIZE * SIZEOFUINT32);
+  labels  = zalloc(code_length / INSTRUCTIONSIZE * SIZEOFUINT32);
+
+  // code begins with bootstrapping which is translated as procedure
+  *leaders = LEADER_PROCEDURE;
+
+  pc = 0;
+
+  while (pc < code_length) {
+    ir = load_instruction(pc);
+
+    decode();
+
+    target = pc + imm;
+
+    if (target < code_length) {
+      if (opcode == OP_BRANCH)
+        *(labels + target / INSTRUCTIONSIZE) = 1;
+      else if (opcode == OP_JAL) {
+        if (rd != REG_ZR)
+          *(leaders + target / INSTRUCTIONSIZE) = LEADER_PROCEDURE;
+        else
+          *(labels + target / INSTRUCTIONSIZE) = 1;
+      }
+    }
+
+    pc = pc + INSTRUCTIONSIZE;
+  }
+}
+
+void translate_runtime() {
+  printf2((uint32_t*) "// %s translated to C by %s\n\n", binary_name, selfie_name);
+
+  print((uint32_t*) "#include <stdint.h>\n#include <stdio.h>\n#include <stdlib.h>\n#include <string.h>\n");
+  print((uint32_t*) "#include <fcntl.h>\n#include <unistd.h>\n\n");
+
+  printf1((uint32_t*) "#define VIRTUALMEMORYSIZE %xu\n", (uint32_t*) VIRTUALMEMORYSIZE);
+  printf1((uint32_t*) "#define PAGESIZE %d\n", (uint32_t*) PAGESIZE);
+  printf1((uint32_t*) "#define ENTRYPOINT %xu\n\n", (uint32_t*) entry_point);
+
+  printf1((uint32_t*) "static uint32_t r[%d];\n\n", (uint32_t*) NUMBEROFREGISTERS);
+
+  print((uint32_t*) "static uint32_t* pages[VIRTUALMEMORYSIZE / PAGESIZE];\n\n");
+
+  print((uint32_t*) "static uint32_t program_break;\n\n");
+
+  print((uint32_t*) "static char* name;\n\n");
+
+  print((uint32_t*) "static void fail(const char* message, int code) {\n");
+  print((uint32_t*) "  printf(\"%s: %s\\n\", name, message);\n  exit(code);\n}\n\n");
+
+  // memory is allocated page by page and zeroed on first access
+  print((uint32_t*) "static uint32_t* m(uint32_t vaddr) {\n  uint32_t* frame;\n\n");
+  printf1((uint32_t*) "  if (vaddr >= VIRTUALMEMORYSIZE) fail(\"uncaught invalid address\", %d);\n", (uint32_t*) EXITCODE_UNCAUGHTEXCEPTION);
+  printf1((uint32_t*) "  if (vaddr %% 4 != 0) fail(\"uncaught invalid address\", %d);\n\n", (uint32_t*) EXITCODE_UNCAUGHTEXCEPTION);
+  print((uint32_t*) "  frame = pages[vaddr / PAGESIZE];\n\n  if (frame == 0) {\n");
+  print((uint32_t*) "    frame = calloc(PAGESIZE, 1);\n\n");
+  printf1((uint32_t*) "    if (frame == 0) fail(\"out of physical memory\", %d);\n\n", (uint32_t*) EXITCODE_OUTOFPHYSICALMEMORY);
+  print((uint32_t*) "    pages[vaddr / PAGESIZE] = frame;\n  }\n\n");
+  print((uint32_t*) "  return frame + vaddr % PAGESIZE / 4;\n}\n\n");
+
+  print((uint32_t*) "static uint32_t divisor(uint32_t value) {\n");
+  printf1((uint32_t*) "  if (value == 0) fail(\"division by zero\", %d);\n\n  return value;\n}\n\n", (uint32_t*) EXITCODE_DIVISIONBYZERO);
+
+  translate_system_calls();
+}
+
+void translate_system_calls() {
+  // read and write transfer at most one word at a time like mipster
+  print((uint32_t*) "static uint32_t transfer(int output) {\n");
+  printf3((uint32_t*) "  uint32_t fd = r[%d], vbuffer = r[%d], size = r[%d];\n", (uint32_t*) REG_A0, (uint32_t*) REG_A1, (uint32_t*) REG_A2);
+  print((uint32_t*) "  uint32_t total = 0, bytes = 4;\n  int actual;\n\n  while (size > 0) {\n");
+  print((uint32_t*) "    if (vbuffer >= VIRTUALMEMORYSIZE || vbuffer % 4 != 0) return -1;\n\n");
+  print((uint32_t*) "    if (size < bytes) bytes = size;\n\n");
+  print((uint32_t*) "    if (output) actual = write(fd, m(vbuffer), bytes);\n");
+  print((uint32_t*) "    else actual = read(fd, m(vbuffer), bytes);\n\n");
+  print((uint32_t*) "    if (actual == (int) bytes) {\n      total = total + actual;\n      size = size - actual;\n\n");
+  print((uint32_t*) "      if (size > 0) vbuffer = vbuffer + 4;\n    } else {\n");
+  print((uint32_t*) "      if (actual > 0) total = total + actual;\n\n      size = 0;\n    }\n  }\n\n");
+  print((uint32_t*) "  return total;\n}\n\n");
+
+  print((uint32_t*) "static uint32_t open_file(void) {\n");
+  printf1((uint32_t*) "  char filename[%d];\n", (uint32_t*) MAX_FILENAME_LENGTH);
+  print((uint32_t*) "  uint32_t i = 0;\n\n  while (i < sizeof(filename)) {\n");
+  printf1((uint32_t*) "    memcpy(filename + i, m(r[%d] + i), 4);\n\n", (uint32_t*) REG_A1);
+  print((uint32_t*) "    if (memchr(filename + i, 0, 4))\n");
+  printf2((uint32_t*) "      return open(filename, r[%d], r[%d]);\n\n    i = i + 4;\n  }\n\n  return -1;\n}\n\n", (uint32_t*) REG_A2, (uint32_t*) REG_A3);
+
+  print((uint32_t*) "static void ecall(void) {\n");
+  printf1((uint32_t*) "  uint32_t a7 = r[%d];\n\n", (uint32_t*) REG_A7);
+  printf2((uint32_t*) "  if (a7 == %d) exit(r[%d]);\n", (uint32_t*) SYSCALL_EXIT, (uint32_t*) REG_A0);
+  printf2((uint32_t*) "  else if (a7 == %d) r[%d] = transfer(0);\n", (uint32_t*) SYSCALL_READ, (uint32_t*) REG_A0);
+  printf2((uint32_t*) "  else if (a7 == %d) r[%d] = transfer(1);\n", (uint32_t*) SYSCALL_WRITE, (uint32_t*) REG_A0);
+  printf2((uint32_t*) "  else if (a7 == %d) r[%d] = open_file();\n", (uint32_t*) SYSCALL_OPENAT, (uint32_t*) REG_A0);
+  printf1((uint32_t*) "  else if (a7 == %d) {\n", (uint32_t*) SYSCALL_BRK);
+  printf2((uint32_t*) "    if (r[%d] >= program_break && r[%d] %% 4 == 0", (uint32_t*) REG_A0, (uint32_t*) REG_A0);
+  printf2((uint32_t*) " && r[%d] < r[%d])\n", (uint32_t*) REG_A0, (uint32_t*) REG_SP);
+  printf1((uint32_t*) "      program_break = r[%d];\n", (uint32_t*) REG_A0);
+  printf1((uint32_t*) "    else\n      r[%d] = program_break;\n", (uint32_t*) REG_A0);
+  printf1((uint32_t*) "  } else fail(\"unknown system call\", %d);\n}\n\n", (uint32_t*) EXITCODE_UNKNOWNSYSCALL);
+}
+
+void translate_main() {
+  uint32_t baddr;
+
+  // code and data are uploaded into virtual memory before
+  // arguments are uploaded onto the stack like mipster does
+
+  print((uint32_t*) "static const uint32_t binary[] = {");
+
+  baddr = 0;
+
+  while (baddr < binary_length) {
+    if (baddr % (8 * REGISTERSIZE) == 0)
+      print((uint32_t*) "\n ");
+
+    printf1((uint32_t*) " %xu,", (uint32_t*) load_data(baddr));
+
+    baddr = baddr + REGISTERSIZE;
+  }
+
+  print((uint32_t*) "\n};\n\n");
+
+  print((uint32_t*) "int main(int argc, char** argv) {\n");
+  print((uint32_t*) "  uint32_t sp = VIRTUALMEMORYSIZE, i, j, bytes;\n");
+  print((uint32_t*) "  uint32_t* vargv = malloc(argc * sizeof(uint32_t));\n  char* s;\n\n");
+  print((uint32_t*) "  name = argv[0];\n\n");
+  print((uint32_t*) "  for (i = 0; i < sizeof(binary) / 4; i = i + 1)\n    *m(ENTRYPOINT + i * 4) = binary[i];\n\n");
+  print((uint32_t*) "  program_break = ENTRYPOINT + sizeof(binary);\n\n");
+  print((uint32_t*) "  for (i = 0; i < (uint32_t) argc; i = i + 1) {\n    bytes = (strlen(argv[i]) + 4) / 4 * 4;\n\n");
+  print((uint32_t*) "    s = calloc(bytes, 1);\n\n    strcpy(s, argv[i]);\n\n    sp = sp - bytes;\n\n");
+  print((uint32_t*) "    for (j = 0; j < bytes; j = j + 4)\n      memcpy(m(sp + j), s + j, 4);\n\n");
+  print((uint32_t*) "    vargv[i] = sp;\n  }\n\n");
+  print((uint32_t*) "  sp = sp - 4;\n  *m(sp) = 0;\n  sp = sp - 4;\n  *m(sp) = 0;\n\n");
+  print((uint32_t*) "  while (i > 0) {\n    sp = sp - 4;\n    i = i - 1;\n    *m(sp) = vargv[i];\n  }\n\n");
+  print((uint32_t*) "  sp = sp - 4;\n  *m(sp) = argc;\n\n");
+  printf1((uint32_t*) "  r[%d] = sp;\n\n", (uint32_t*) REG_SP);
+  print((uint32_t*) "  p_0x0();\n\n  return 0;\n}\n");
+}
+
+void translate_jump(uint32_t target, uint32_t from, uint32_t to) {
+  // from and to delimit the procedure being translated
+  if (target < code_length) {
+    if (target >= from) {
+      if (target < to) {
+        printf1((uint32_t*) "goto L_%x;\n", (uint32_t*) target);
+
+        return;
+      }
+    }
+
+    if (*(leaders + target / INSTRUCTIONSIZE) == LEADER_PROCEDURE) {
+      // jumping into another procedure is a tail call
+      printf1((uint32_t*) "{ p_%x(); return; }\n", (uint32_t*) target);
+
+      return;
+    }
+  }
+
+  printf1((uint32_t*) "fail(\"unsupported jump\", %d);\n", (uint32_t*) EXITCODE_UNKNOWNINSTRUCTION);
+}
+
+void translate_instruction(uint32_t from, uint32_t to) {
+  uint32_t handler;
+
+  handler = decode_handler();
+
+  print((uint32_t*) "  ");
+
+  if (handler == HANDLER_BEQ) {
+    printf2((uint32_t*) "if (r[%d] == r[%d]) ", (uint32_t*) rs1, (uint32_t*) rs2);
+
+    translate_jump(pc + imm, from, to);
+  } else if (handler == HANDLER_JAL) {
+    if (rd != REG_ZR) {
+      // calls return to the next instruction which is
+      // where the translated procedure returns to as well
+      printf2((uint32_t*) "r[%d] = %xu; ", (uint32_t*) rd, (uint32_t*) (entry_point + pc + INSTRUCTIONSIZE));
+      printf1((uint32_t*) "p_%x();\n", (uint32_t*) (pc + imm));
+    } else
+      translate_jump(pc + imm, from, to);
+  } else if (handler == HANDLER_JALR) {
+    if (rd == REG_ZR)
+      // jalr without link only appears in procedure epilogues
+      print((uint32_t*) "return;\n");
+    else
+      printf1((uint32_t*) "fail(\"unsupported indirect call\", %d);\n", (uint32_t*) EXITCODE_UNKNOWNINSTRUCTION);
+  } else if (handler == HANDLER_ECALL)
+    print((uint32_t*) "ecall();\n");
+  else if (handler == HANDLER_UNKNOWN)
+    printf1((uint32_t*) "fail(\"uncaught unknown instruction\", %d);\n", (uint32_t*) EXITCODE_UNCAUGHTEXCEPTION);
+  else if (handler == HANDLER_SW)
+    printf3((uint32_t*) "*m(r[%d] + %xu) = r[%d];\n", (uint32_t*) rs1, (uint32_t*) imm, (uint32_t*) rs2);
+  else if (rd == REG_ZR) {
+    if (handler == HANDLER_LW)
+      // loads into zero register may still fault
+      printf2((uint32_t*) "m(r[%d] + %xu);\n", (uint32_t*) rs1, (uint32_t*) imm);
+    else if (handler == HANDLER_DIVU)
+      printf1((uint32_t*) "divisor(r[%d]);\n", (uint32_t*) rs2);
+    else if (handler == HANDLER_REMU)
+      printf1((uint32_t*) "divisor(r[%d]);\n", (uint32_t*) rs2);
+    else
+      print((uint32_t*) ";\n");
+  } else {
+    printf1((uint32_t*) "r[%d] = ", (uint32_t*) rd);
+
+    if (handler == HANDLER_ADDI)
+      printf2((uint32_t*) "r[%d] + %xu;\n", (uint32_t*) rs1, (uint32_t*) imm);
+    else if (handler == HANDLER_LW)
+      printf2((uint32_t*) "*m(r[%d] + %xu);\n", (uint32_t*) rs1, (uint32_t*) imm);
+    else if (handler == HANDLER_LUI)
+      printf1((uint32_t*) "%xu;\n", (uint32_t*) left_shift(imm, 12));
+    else if (handler == HANDLER_ADD)
+      printf2((uint32_t*) "r[%d] + r[%d];\n", (uint32_t*) rs1, (uint32_t*) rs2);
+    else if (handler == HANDLER_SUB)
+      printf2((uint32_t*) "r[%d] - r[%d];\n", (uint32_t*) rs1, (uint32_t*) rs2);
+    else if (handler == HANDLER_MUL)
+      printf2((uint32_t*) "r[%d] * r[%d];\n", (uint32_t*) rs1, (uint32_t*) rs2);
+    else if (handler == HANDLER_DIVU)
+      printf2((uint32_t*) "r[%d] / divisor(r[%d]);\n", (uint32_t*) rs1, (uint32_t*) rs2);
+    else if (handler == HANDLER_REMU)
+      printf2((uint32_t*) "r[%d] %% divisor(r[%d]);\n", (uint32_t*) rs1, (uint32_t*) rs2);
+    else if (handler == HANDLER_SLTU)
+      printf2((uint32_t*) "r[%d] < r[%d];\n", (uint32_t*) rs1, (uint32_t*) rs2);
+  }
+}
+
+uint32_t next_procedure(uint32_t from) {
+  from = from + INSTRUCTIONSIZE;
+
+  while (from < code_length) {
+    if (*(leaders + from / INSTRUCTIONSIZE) == LEADER_PROCEDURE)
+      return from;
+
+    from = from + INSTRUCTIONSIZE;
+  }
+
+  return code_length;
+}
+
+void translate_procedures() {
+  uint32_t from;
+  uint32_t to;
+
+  // declare all procedures first
+  pc = 0;
+
+  while (pc < code_length) {
+    if (*(leaders + pc / INSTRUCTIONSIZE) == LEADER_PROCEDURE) {
+      printf1((uint32_t*) "static void p_%x(void);\n", (uint32_t*) pc);
+
+      number_of_translated_procedures = number_of_translated_procedures + 1;
+    }
+
+    pc = pc + INSTRUCTIONSIZE;
+  }
+
+  println();
+
+  pc = 0;
+
+  while (pc < code_length) {
+    // one C function per procedure from its first instruction
+    // up to the first instruction of the next procedure
+    from = pc;
+    to   = next_procedure(pc);
+
+    printf1((uint32_t*) "static void p_%x(void) {\n", (uint32_t*) from);
+
+    while (pc < to) {
+      ir = load_instruction(pc);
+
+      decode();
+
+      // one label per basic block that is jumped to
+      if (*(labels + pc / INSTRUCTIONSIZE))
+        printf1((uint32_t*) "L_%x:\n", (uint32_t*) pc);
+
+      translate_instruction(from, to);
+
+      pc = pc + INSTRUCTIONSIZE;
+    }
+
+    if (to < code_length)
+      // falling through into the next procedure
+      printf1((uint32_t*) "  p_%x();\n", (uint32_t*) to);
+
+    print((uint32_t*) "}\n\n");
+  }
+}
+
+void selfie_translate() {
+  uint32_t number_of_characters;
+
+  translation_name = get_argument();
+
+  if (code_length == 0) {
+    printf2((uint32_t*) "%s: nothing to translate to output file %s\n", selfie_name, translation_name);
+
+    return;
+  }
+
+  // assert: translation_name is mapped and not longer than MAX_FILENAME_LENGTH
+
+  translation_fd = open_write_only(translation_name);
+
+  if (signed_less_than(translation_fd, 0)) {
+    printf2((uint32_t*) "%s: could not create translation output file %s\n", selfie_name, translation_name);
+
+    exit(EXITCODE_IOERROR);
+  }
+
+  output_name = translation_name;
+  output_fd   = translation_fd;
+
+  number_of_characters = number_of_written_characters;
+
+  number_of_translated_procedures = 0;
+
+  find_leaders();
+
+  translate_runtime();
+  translate_procedures();
+  translate_main();
+
+  output_name = (uint32_t*) 0;
+  output_fd   = 1;
+
+  printf5((uint32_t*) "%s: %d characters of C with %d procedures and %d instructions written into %s\n", selfie_name,
+    (uint32_t*) (number_of_written_characters - number_of_characters),
+    (uint32_t*) number_of_translated_procedures,
+    (uint32_t*) (code_length / INSTRUCTIONSIZE),
+    translation_name);
+}
+
+// -----------------------------------------------------------------
+// ---------------------------- CONTEXTS ---------------------------
+// -----------------------------------------------------------------
+
+uint32_t* allocate_context(uint32_t* parent, uint32_t* vctxt, uint32_t* in) {
+  uint32_t* context;
+
+  if (free_contexts == (uint32_t*) 0) {
+    context = smalloc(15 * SIZEOFUINT32STAR + 15 * SIZEOFUINT32);
+
+    // allocate zeroed memory for general purpose registers
+    set_regs(context, zalloc(NUMBEROFREGISTERS * REGISTERSIZE));
+
+    // allocate page table with leaf tables allocated on first use
+    set_pt(context, allocate_page_table());
+
+    // software tlb is allocated on first use
+    set_software_tlb(context, (uint32_t*) 0);
+
+    // decoded instruction cache is allocated on first use
+    set_decode_cache(context, (uint32_t*) 0);
+    set_decode_length(context, 0);
+
+    set_dirty_log(context, smalloc(DIRTYPAGES * SIZEOFUINT32));
+  } else {
+    context = free_contexts;
+
+    free_contexts = get_next_context(free_contexts);
+
+    // reuse registers, page table, software tlb,
+    // decoded instruction cache, and dirty log
+    clear_context(context);
+  }
+
+  set_next_context(context, in);
+  set_prev_context(context, (uint32_t*) 0);
+
+  if (in != (uint32_t*) 0)
+    set_prev_context(in, context);
+
+  set_pc(context, 0);
+
+  // determine range of recently mapped pages
+  set_lo_page(context, 0);
+  set_me_page(context, 0);
+  set_hi_page(context, get_page_of_virtual_address(VIRTUALMEMORYSIZE - REGISTERSIZE));
+
+  set_dirty_pages(context, 0);
+
+  set_exception(context, EXCEPTION_NOEXCEPTION);
+  set_faulting_page(context, 0);
+
+  set_exit_code(context, EXITCODE_NOERROR);
+
+  set_parent(context, parent);
+  set_virtual_context(context, vctxt);
+
+  set_name(context, (uint32_t*) 0);
+
+  set_next_ready(context, (uint32_t*) 0);
+  set_state(context, STATE_RUNNABLE);
+
+  set_next_hashed(context, (uint32_t*) 0);
+
+  set_pid(context, 0);
+  set_forker(context, (uint32_t*) 0);
+
+  set_children(context, (uint32_t*) 0);
+  set_next_sibling(context, (uint32_t*) 0);
+
+  set_paravirtual(context, paravirtual_calls);
+
+  set_hosting(context, 0);
+
+  return context;
+}
+
+uint32_t hash_context(uint32_t* parent, uint32_t* vctxt) {
+  // contexts are word-aligned
+  return ((uint32_t) parent + (uint32_t) vctxt) / SIZEOFUINT32STAR % CONTEXTBUCKETS;
+}
+
+void index_context(uint32_t* context) {
+  uint32_t* bucket;
+
+  bucket = context_index + hash_context(get_parent(context), get_virtual_context(context));
+
+  set_next_hashed(context, (uint32_t*) *bucket);
+
+  *bucket = (uint32_t) context;
+}
+
+void unindex_context(uint32_t* context) {
+  uint32_t* bucket;
+  uint32_t* previous;
+
+  bucket = context_index + hash_context(get_parent(context), get_virtual_context(context));
+
+  if ((uint32_t*) *bucket == context)
+    *bucket = (uint32_t) get_next_hashed(context);
+  else {
+    previous = (uint32_t*) *bucket;
+
+    while (get_next_hashed(previous) != context)
+      previous = get_next_hashed(previous);
+
+    set_next_hashed(previous, get_next_hashed(context));
+  }
+
+  set_next_hashed(context, (uint32_t*) 0);
+}
+
+uint32_t* find_context(uint32_t* parent, uint32_t* vctxt) {
+  uint32_t* context;
+
+  context = (uint32_t*) *(context_index + hash_context(parent, vctxt));
+
+  while (context != (uint32_t*) 0) {
+    if (get_parent(context) == parent)
+      if (get_virtual_context(context) == vctxt)
+        return context;
+
+    context = get_next_hashed(context);
+  }
+
+  return (uint32_t*) 0;
+}
+
+void clear_context(uint32_t* context) {
+  uint32_t* table;
+  uint32_t  page;
+  uint32_t  i;
+
+  i = 0;
+
+  while (i < NUMBEROFREGISTERS) {
+    *(get_regs(context) + i) = 0;
+
+    i = i + 1;
+  }
+
+  table = get_pt(context);
+
+  // assert: context page table is only mapped from beginning up and end down
+
+  // unmap low pages from the bottom since our parent
+  // may have advanced the lo page while restoring us
+  page = 0;
+
+  while (page <= get_me_page(context)) {
+    unmap_page(table, page);
+
+    page = page + 1;
+  }
+
+  page = get_page_of_virtual_address(VIRTUALMEMORYSIZE - REGISTERSIZE);
+
+  while (is_page_mapped(table, page)) {
+    unmap_page(table, page);
+
+    page = page - 1;
+  }
+
+  flush_tlb(get_software_tlb(context));
+
+  invalidate_decoded_instructions(context, entry_point, get_decode_length(context));
+}
+
+void free_context(uint32_t* context) {
+  set_next_context(context, free_contexts);
+
+  free_contexts = context;
+}
+
+uint32_t* delete_context(uint32_t* context, uint32_t* from) {
+  unindex_context(context);
+
+  release_page_frames(context);
+
+  if (get_next_context(context) != (uint32_t*) 0)
+    set_prev_context(get_next_context(context), get_prev_context(context));
+
+  if (get_prev_context(context) != (uint32_t*) 0) {
+    set_next_context(get_prev_context(context), get_next_context(context));
+    set_prev_context(context, (uint32_t*) 0);
+  } else
+    from = get_next_context(context);
+
+  free_context(context);
+
+  return from;
+}
+
+// -----------------------------------------------------------------
+// -------------------------- MICROKERNEL --------------------------
+// -----------------------------------------------------------------
+
+uint32_t* create_context(uint32_t* parent, uint32_t* vctxt) {
+  // TODO: check if context already exists
+  used_contexts = allocate_context(parent, vctxt, used_contexts);
+
+  index_context(used_contexts);
+
+  set_pid(used_contexts, next_pid);
+
+  next_pid = next_pid + 1;
+
+  if (parent != MY_CONTEXT)
+    if (get_hosting(parent) == 0) {
+      set_hosting(parent, 1);
+
+      // memory of hosting contexts is accessed without page faults
+      page_in_context(parent);
+    }
+
+  if (current_context == (uint32_t*) 0)
+    current_context = used_contexts;
+
+  if (debug_create)
+    printf3((uint32_t*) "%s: parent context %p created child context %p\n", selfie_name, parent, used_contexts);
+
+  return used_contexts;
+}
+
+uint32_t* cache_context(uint32_t* vctxt) {
+  uint32_t* context;
+
+  // find cached context on my boot level
+  context = find_context(current_context, vctxt);
+
+  if (context == (uint32_t*) 0) {
+    context_misses = context_misses + 1;
+
+    // create cached context on my boot level
+    context = create_context(current_context, vctxt);
+  } else
+    context_hits = context_hits + 1;
+
+  if (debug_switch)
+    printf3((uint32_t*) "%s: context lookup with %d hits and %d misses\n", selfie_name, (uint32_t*) context_hits, (uint32_t*) context_misses);
+
+  return context;
+}
+
+void make_ready(uint32_t* context) {
+  // assert: context is not running and not in ready queue
+  set_state(context, STATE_RUNNABLE);
+
+  set_next_ready(context, (uint32_t*) 0);
+
+  if (ready_contexts == (uint32_t*) 0)
+    ready_contexts = context;
+  else
+    set_next_ready(last_ready_context, context);
+
+  last_ready_context = context;
+
+  number_of_ready_contexts = number_of_ready_contexts + 1;
+}
+
+void block_context(uint32_t* context) {
+  // assert: context is running and thus not in ready queue
+  set_state(context, STATE_BLOCKED);
+
+  number_of_blocked_contexts = number_of_blocked_contexts + 1;
+}
+
+void unblock_context(uint32_t* context) {
+  if (get_state(context) == STATE_BLOCKED) {
+    number_of_blocked_contexts = number_of_blocked_contexts - 1;
+
+    make_ready(context);
+  }
+}
+
+uint32_t* schedule(uint32_t* from_context) {
+  uint32_t* context;
+
+  // round robin: a runnable context goes to the end of
+  // the ready queue and the context at its head runs next,
+  // or nothing if there is no runnable context left
+
+  if (get_state(from_context) == STATE_RUNNABLE)
+    make_ready(from_context);
+  else if (get_state(from_context) == STATE_EXITED)
+    retire_context(from_context);
+
+  context = ready_contexts;
+
+  if (context != (uint32_t*) 0) {
+    ready_contexts = get_next_ready(context);
+
+    if (ready_contexts == (uint32_t*) 0)
+      last_ready_context = (uint32_t*) 0;
+
+    set_next_ready(context, (uint32_t*) 0);
+
+    number_of_ready_contexts = number_of_ready_contexts - 1;
+  } else if (number_of_blocked_contexts > 0)
+    printf2((uint32_t*) "%s: deadlock with %d blocked contexts\n", selfie_name, (uint32_t*) number_of_blocked_contexts);
+
+  return context;
+}
+
+uint32_t time_slice() {
+  uint32_t slice;
+
+  // distribute time slice fairly across running and ready contexts
+  slice = timeslice / (number_of_ready_contexts + 1);
+
+  if (slice == 0)
+    return 1;
+  else
+    return slice;
+}
+
+void save_context(uint32_t* context) {
+  uint32_t* parent_table;
+  uint32_t* vctxt;
+
+  // save machine state
+  set_pc(context, pc);
+
+  if (get_parent(context) != MY_CONTEXT) {
+    parent_table = get_pt(get_parent(context));
+
+    vctxt = get_virtual_context(context);
+
+    store_virtual_memory(parent_table, program_counter(vctxt), get_pc(context));
+
+    // copy registers in bulk, translating once per page
+    store_virtual_words(parent_table, load_virtual_memory(parent_table, regs(vctxt)), get_regs(context), NUMBEROFREGISTERS * REGISTERSIZE);
+
+    // the virtual context has the same layout as the context, with
+    // program break, exception, faulting page, and exit code in a row
+    store_virtual_words(parent_table, program_break(vctxt), (uint32_t*) program_break(context), 4 * REGISTERSIZE);
+  }
+}
+
+void map_page(uint32_t* context, uint32_t page, uint32_t frame) {
+  uint32_t* table;
+  uint32_t  remapped;
+
+  table = get_pt(context);
+
+  // assert: 0 <= page < VIRTUALMEMORYSIZE / PAGESIZE
+
+  remapped = 0;
+
+  if (get_frame_for_page(table, page) != 0)
+    if (get_frame_for_page(table, page) != frame)
+      remapped = 1;
+
+  set_frame_for_page(table, page, frame);
+
+  if (remapped)
+    if (get_hosting(context))
+      invalidate_hosted_contexts(context);
+
+  // instructions on a remapped page must be decoded again
+  invalidate_decoded_instructions(context, page * PAGESIZE, PAGESIZE);
+
+  // and translations of a remapped page looked up again
+  flush_tlb_entry(get_software_tlb(context), page);
+
+  if (get_parent(context) == MY_CONTEXT)
+    // frames of hosted contexts belong to their parents
+    track_page(context, page);
+
+  if (page <= get_page_of_virtual_address(get_program_break(context) - REGISTERSIZE)) {
+    // exploit spatial locality in page table caching
+    if (page < get_lo_page(context))
+      set_lo_page(context, page);
+    else if (page > get_me_page(context))
+      set_me_page(context, page);
+  } else if (page > get_hi_page(context))
+    // remapped stack pages are restored again
+    set_hi_page(context, page);
+
+  // hosting boot levels restore only logged pages unless the log overflowed
+  if (get_dirty_pages(context) < DIRTYPAGES)
+    *(get_dirty_log(context) + get_dirty_pages(context)) = page;
+
+  if (get_dirty_pages(context) <= DIRTYPAGES)
+    set_dirty_pages(context, get_dirty_pages(context) + 1);
+
+  if (debug_map) {
+    printf1((uint32_t*) "%s: page ", selfie_name);
+    print_hexadecimal(page, 4);
+    printf2((uint32_t*) " mapped to frame %p in context %p\n", (uint32_t*) frame, context);
+  }
+}
+
+uint32_t load_frame_for_page(uint32_t* parent_table, uint32_t* table, uint32_t page) {
+  uint32_t vaddr;
+  uint32_t leaf;
+  uint32_t frame;
+
+  // walk page table of hosted context in virtual memory of its parent,
+  // unmapped parts of page tables have not been touched and are empty;
+  // page tables are controlled by the parent, so anything that is not
+  // a valid page table is treated as unmapped as well
+
+  vaddr = (uint32_t) (table + page / LEAFTABLEPAGES);
+
+  if (is_valid_virtual_address(vaddr))
+    if (is_virtual_address_mapped(parent_table, vaddr)) {
+      leaf = load_virtual_memory(parent_table, vaddr);
+
+      if (leaf != 0)
+        if (leaf % PAGESIZE == 0) {
+          vaddr = (uint32_t) ((uint32_t*) leaf + page % LEAFTABLEPAGES);
+
+          if (is_valid_virtual_address(vaddr))
+            if (is_virtual_address_mapped(parent_table, vaddr)) {
+              frame = load_virtual_memory(parent_table, vaddr);
+
+              // frames are page-aligned up to their read-only mark
+              if (is_valid_virtual_address(frame - frame % PAGESIZE))
+                return frame;
+            }
+        }
+    }
+
+  return 0;
+}
+
+void map_hosted_page(uint32_t* context, uint32_t* parent_table, uint32_t page, uint32_t frame) {
+  // frame is the page table entry of page in the hosted context
+  map_page(context, page, get_frame_for_page(parent_table, get_page_of_virtual_address(frame)));
+
+  if (frame % PAGESIZE == READONLY)
+    // copy on write is up to the parent
+    write_protect_page(get_pt(context), page);
+}
+
+void restore_context(uint32_t* context) {
+  uint32_t* parent_table;
+  uint32_t* vctxt;
+  uint32_t* table;
+  uint32_t page;
+  uint32_t me;
+  uint32_t frame;
+  uint32_t dirty;
+  uint32_t* log;
+
+  if (get_parent(context) != MY_CONTEXT) {
+    parent_table = get_pt(get_parent(context));
+
+    vctxt = get_virtual_context(context);
+
+    // the software tlb survives switching since map_page flushes
+    // remapped pages of the context and invalidate_hosted_contexts
+    // all pages whenever the parent remaps one of its own pages
+
+    set_pc(context, load_virtual_memory(parent_table, program_counter(vctxt)));
+
+    load_virtual_words(parent_table, load_virtual_memory(parent_table, regs(vctxt)), get_regs(context), NUMBEROFREGISTERS * REGISTERSIZE);
+
+    load_virtual_words(parent_table, program_break(vctxt), (uint32_t*) program_break(context), 4 * REGISTERSIZE);
+
+    table = (uint32_t*) load_virtual_memory(parent_table, page_table(vctxt));
+
+    dirty = load_virtual_memory(parent_table, dirty_pages(vctxt));
+
+    if (dirty <= DIRTYPAGES) {
+      // replay only the pages remapped since we last restored the context
+      log = (uint32_t*) load_virtual_memory(parent_table, dirty_log(vctxt));
+
+      while (dirty > 0) {
+        dirty = dirty - 1;
+
+        page = load_virtual_memory(parent_table, (uint32_t) (log + dirty));
+
+        frame = load_frame_for_page(parent_table, table, page);
+
+        if (frame != 0)
+          map_hosted_page(context, parent_table, page, frame);
+      }
+
+      // low pages up to the me page are restored, stack pages are
+      // still restored from the hi page down if the log overflows
+      store_virtual_memory(parent_table, lo_page(vctxt), load_virtual_memory(parent_table, me_page(vctxt)) + 1);
+    } else {
+      // assert: context page table is only mapped from beginning up and end down
+
+      page = load_virtual_memory(parent_table, lo_page(vctxt));
+      me   = load_virtual_memory(parent_table, me_page(vctxt));
+
+      while (page <= me) {
+        frame = load_frame_for_page(parent_table, table, page);
+
+        if (frame != 0)
+          map_hosted_page(context, parent_table, page, frame);
+
+        page = page + 1;
+      }
+
+      store_virtual_memory(parent_table, lo_page(vctxt), page);
+
+      page = load_virtual_memory(parent_table, hi_page(vctxt));
+
+      frame = load_frame_for_page(parent_table, table, page);
+
+      while (frame != 0) {
+        map_hosted_page(context, parent_table, page, frame);
+
+        page  = page - 1;
+
+        frame = load_frame_for_page(parent_table, table, page);
+      }
+
+      store_virtual_memory(parent_table, hi_page(vctxt), page);
+    }
+
+    store_virtual_memory(parent_table, dirty_pages(vctxt), 0);
+  }
+}
+
+// -----------------------------------------------------------------
+// ---------------------------- KERNEL -----------------------------
+// -----------------------------------------------------------------
+
+uint32_t pavailable() {
+  if (free_page_frames != (uint32_t*) 0)
+    return 1;
+  else if (free_page_frame_memory > 0)
+    return 1;
+  else if (allocated_page_frame_memory + MEGABYTE <= page_frame_memory)
+    return 1;
+  else
+    return 0;
+}
+
+uint32_t pexcess() {
+  if (pavailable())
+    return 1;
+  else if (allocated_page_frame_memory + MEGABYTE <= 2 * page_frame_memory)
+    // tolerate twice as much memory mapped on demand than physically available
+    return 1;
+  else
+    return 0;
+}
+
+uint32_t pused() {
+  return allocated_page_frame_memory - free_page_frame_memory - freed_page_frame_memory;
+}
+
+uint32_t* map_page_frame_memory() {
+  uint32_t* memory;
+
+  // on boot level zero, the host zeroes page frames on first
+  // touch rather than us zeroing all page frame memory upfront
+  if (is_boot_level_zero() == 0)
+    return (uint32_t*) MAP_FAILED;
+  else if (page_frame_memory == 0)
+    return (uint32_t*) MAP_FAILED;
+
+  memory = mmap((uint32_t*) 0, page_frame_memory, PROT_READ_WRITE, LINUX_MAP_PRIVATE_ANONYMOUS, -1, 0);
+
+  if (memory == (uint32_t*) MAP_FAILED)
+    memory = mmap((uint32_t*) 0, page_frame_memory, PROT_READ_WRITE, MAC_MAP_PRIVATE_ANONYMOUS, -1, 0);
+
+  return memory;
+}
+
+uint32_t* palloc() {
+  uint32_t block;
+  uint32_t frame;
+  uint32_t i;
+
+  if (free_page_frames == (uint32_t*) 0)
+    if (free_page_frame_memory == 0)
+      if (pexcess() == 0)
+        // evict a page frame onto the list of freed page frames
+        page_out();
+
+  if (free_page_frames != (uint32_t*) 0) {
+    // reuse most recently freed page frame
+    frame = (uint32_t) free_page_frames;
+
+    free_page_frames = (uint32_t*) *free_page_frames;
+
+    freed_page_frame_memory = freed_page_frame_memory - PAGESIZE;
+
+    i = 0;
+
+    while (i < PAGESIZE / REGISTERSIZE) {
+      // erase previous contents of page frame
+      *((uint32_t*) frame + i) = 0;
+
+      i = i + 1;
+    }
+
+    return (uint32_t*) frame;
+  }
+
+  // assert: page_frame_memory is equal to or a multiple of MEGABYTE
+  // assert: PAGESIZE is a factor of MEGABYTE strictly less than MEGABYTE
+
+  if (next_page_frame == 0) {
+    block = (uint32_t) map_page_frame_memory();
+
+    if (block != MAP_FAILED) {
+      // all page frame memory is reserved at once, in addition
+      // to page frames mapped from a restored snapshot, if any
+      allocated_page_frame_memory = allocated_page_frame_memory + page_frame_memory;
+      free_page_frame_memory      = page_frame_memory;
+
+      // mapped memory is page-aligned
+      next_page_frame = block;
+    }
+  }
+
+  if (free_page_frame_memory == 0) {
+    if (pexcess()) {
+      free_page_frame_memory = MEGABYTE;
+
+      // on boot level zero allocate zeroed memory
+      block = (uint32_t) zalloc(free_page_frame_memory);
+
+      allocated_page_frame_memory = allocated_page_frame_memory + free_page_frame_memory;
+
+      // page frames must be page-aligned to work as page table index
+      next_page_frame = round_up(block, PAGESIZE);
+
+      if (next_page_frame > block)
+        // losing one page frame to fragmentation
+        free_page_frame_memory = free_page_frame_memory - PAGESIZE;
+    } else {
+      print(selfie_name);
+      print((uint32_t*) ": palloc out of physical memory\n");
+
+      exit(EXITCODE_OUTOFPHYSICALMEMORY);
+    }
+  }
+
+  frame = next_page_frame;
+
+  next_page_frame = next_page_frame + PAGESIZE;
+
+  free_page_frame_memory = free_page_frame_memory - PAGESIZE;
+
+  if (pused() > peak_page_frame_memory)
+    peak_page_frame_memory = pused();
+
+  // strictly, touching is only necessary on boot levels higher than zero
+  return touch((uint32_t*) frame, PAGESIZE);
+}
+
+void pfree(uint32_t* frame) {
+  *frame = (uint32_t) free_page_frames;
+
+  free_page_frames = frame;
+
+  freed_page_frame_memory = freed_page_frame_memory + PAGESIZE;
+}
+
+uint32_t* find_shared_frame(uint32_t frame) {
+  uint32_t* shared;
+
+  if (shared_frames == (uint32_t*) 0)
+    return (uint32_t*) 0;
+
+  shared = (uint32_t*) *(shared_frames + frame / PAGESIZE % SHAREDBUCKETS);
+
+  while (shared != (uint32_t*) 0) {
+    if (*(shared + 1) == frame)
+      return shared;
+
+    shared = (uint32_t*) *shared;
+  }
+
+  return (uint32_t*) 0;
+}
+
+uint32_t is_frame_shared(uint32_t frame) {
+  if (find_shared_frame(frame) != (uint32_t*) 0)
+    return 1;
+  else
+    return 0;
+}
+
+void share_frame(uint32_t frame) {
+  uint32_t* shared;
+
+  shared = find_shared_frame(frame);
+
+  if (shared != (uint32_t*) 0) {
+    *(shared + 2) = *(shared + 2) + 1;
+
+    return;
+  }
+
+  if (shared_frames == (uint32_t*) 0)
+    shared_frames = zalloc(SHAREDBUCKETS * SIZEOFUINT32STAR);
+
+  if (free_shared_frames != (uint32_t*) 0) {
+    shared = free_shared_frames;
+
+    free_shared_frames = (uint32_t*) *free_shared_frames;
+  } else
+    shared = smalloc(SIZEOFUINT32STAR + 2 * SIZEOFUINT32);
+
+  *(shared + 1) = frame;
+  *(shared + 2) = 2;
+
+  *shared = *(shared_frames + frame / PAGESIZE % SHAREDBUCKETS);
+
+  *(shared_frames + frame / PAGESIZE % SHAREDBUCKETS) = (uint32_t) shared;
+}
+
+uint32_t unshare_frame(uint32_t frame) {
+  uint32_t* bucket;
+  uint32_t* shared;
+
+  // drop one reference to frame and return 1 if
+  // frame is still mapped by other pages, otherwise 0
+
+  if (shared_frames == (uint32_t*) 0)
+    return 0;
+
+  bucket = shared_frames + frame / PAGESIZE % SHAREDBUCKETS;
+
+  shared = (uint32_t*) *bucket;
+
+  while (shared != (uint32_t*) 0) {
+    if (*(shared + 1) == frame) {
+      *(shared + 2) = *(shared + 2) - 1;
+
+      if (*(shared + 2) == 1) {
+        // frame is not shared anymore
+        *bucket = *shared;
+
+        *shared = (uint32_t) free_shared_frames;
+
+        free_shared_frames = shared;
+      }
+
+      return 1;
+    }
+
+    bucket = shared;
+    shared = (uint32_t*) *shared;
+  }
+
+  return 0;
+}
+
+void release_page_frames(uint32_t* context) {
+  uint32_t* table;
+  uint32_t* leaf;
+  uint32_t i;
+  uint32_t j;
+  uint32_t frame;
+
+  // only contexts on my boot level own the page frames they map,
+  // page frames of hosted contexts belong to their parents
+  if (get_parent(context) != MY_CONTEXT)
+    return;
+
+  table = get_pt(context);
+
+  i = 0;
+
+  while (i < VIRTUALMEMORYSIZE / PAGESIZE / LEAFTABLEPAGES) {
+    leaf = (uint32_t*) *(table + i);
+
+    if (leaf != (uint32_t*) 0) {
+      j = 0;
+
+      while (j < LEAFTABLEPAGES) {
+        if (*(leaf + j) != 0) {
+          // ignore read-only mark
+          frame = *(leaf + j) - *(leaf + j) % PAGESIZE;
+
+          // shared frames remain mapped by other pages
+          if (unshare_frame(frame) == 0)
+            pfree((uint32_t*) frame);
+
+          // unmap page
+          *(leaf + j) = 0;
+        }
+
+        j = j + 1;
+      }
+    }
+
+    i = i + 1;
+  }
+
+  flush_tlb(get_software_tlb(context));
+
+  discard_swapped_pages(context);
+}
+
+void track_page(uint32_t* context, uint32_t page) {
+  uint32_t* resident;
+
+  if (swapping == 0)
+    return;
+  else if (page < get_page_of_virtual_address(get_original_break(context) + PAGESIZE - 1))
+    // code and data stay resident since instructions are fetched without page faults
+    return;
+
+  if (free_resident_pages != (uint32_t*) 0) {
+    resident = free_resident_pages;
+
+    free_resident_pages = (uint32_t*) *free_resident_pages;
+  } else
+    resident = smalloc(2 * SIZEOFUINT32STAR + SIZEOFUINT32);
+
+  *(resident + 1) = (uint32_t) context;
+  *(resident + 2) = page;
+
+  if (resident_pages == (uint32_t*) 0)
+    *resident = (uint32_t) resident;
+  else {
+    *resident = *resident_pages;
+
+    *resident_pages = (uint32_t) resident;
+  }
+
+  // insert behind clock hand to be considered last
+  resident_pages = resident;
+
+  number_of_resident_pages = number_of_resident_pages + 1;
+}
+
+void untrack_next_page() {
+  uint32_t* resident;
+
+  resident = (uint32_t*) *resident_pages;
+
+  if (resident == resident_pages)
+    resident_pages = (uint32_t*) 0;
+  else
+    *resident_pages = *resident;
+
+  *resident = (uint32_t) free_resident_pages;
+
+  free_resident_pages = resident;
+
+  number_of_resident_pages = number_of_resident_pages - 1;
+}
+
+void invalidate_hosted_contexts(uint32_t* context) {
+  uint32_t* hosted;
+  uint32_t* vctxt;
+
+  hosted = used_contexts;
+
+  while (hosted != (uint32_t*) 0) {
+    if (get_parent(hosted) == context) {
+      // translations of hosted contexts go directly to my frames
+      // and may thus refer to the frame that was just remapped
+      flush_tlb(get_software_tlb(hosted));
+
+      vctxt = get_virtual_context(hosted);
+
+      // restore all pages of the hosted context again
+      store_virtual_memory(get_pt(context), lo_page(vctxt), 0);
+      store_virtual_memory(get_pt(context), hi_page(vctxt), get_page_of_virtual_address(VIRTUALMEMORYSIZE - REGISTERSIZE));
+      store_virtual_memory(get_pt(context), dirty_pages(vctxt), DIRTYPAGES + 1);
+    }
+
+    hosted = get_next_context(hosted);
+  }
+}
+
+uint32_t open_swap_file() {
+  if (swap_fd == 0) {
+    if (swap_file_name == (uint32_t*) 0)
+      swap_file_name = (uint32_t*) "selfie.swap";
+
+    swap_fd = open_read_write(swap_file_name);
+
+    if (signed_less_than(swap_fd, 0) == 0) {
+      // the swap file is removed right away and thus disappears
+      // when it is closed at exit, even if selfie terminates early
+      unlink(swap_file_name);
+
+      swapped_pages = zalloc(SWAPBUCKETS * SIZEOFUINT32STAR);
+    }
+  }
+
+  if (signed_less_than(swap_fd, 0))
+    return 0;
+  else
+    return 1;
+}
+
+uint32_t hash_swapped_page(uint32_t* context, uint32_t page) {
+  // contexts are word-aligned
+  return ((uint32_t) context / SIZEOFUINT32STAR + page) % SWAPBUCKETS;
+}
+
+uint32_t* allocate_swapped_page(uint32_t* context, uint32_t page) {
+  uint32_t* swapped;
+
+  if (free_swap_slots != (uint32_t*) 0) {
+    swapped = free_swap_slots;
+
+    free_swap_slots = (uint32_t*) *free_swap_slots;
+  } else {
+    swapped = smalloc(3 * SIZEOFUINT32STAR + SIZEOFUINT32);
+
+    *(swapped + 3) = next_swap_slot;
+
+    next_swap_slot = next_swap_slot + 1;
+  }
+
+  *(swapped + 1) = (uint32_t) context;
+  *(swapped + 2) = page;
+
+  *swapped = *(swapped_pages + hash_swapped_page(context, page));
+
+  *(swapped_pages + hash_swapped_page(context, page)) = (uint32_t) swapped;
+
+  number_of_swapped_pages = number_of_swapped_pages + 1;
+
+  return swapped;
+}
+
+void read_swap_slot(uint32_t slot, uint32_t* frame) {
+  lseek(swap_fd, slot * PAGESIZE, SEEK_SET);
+
+  if (read(swap_fd, frame, PAGESIZE) != PAGESIZE) {
+    printf1((uint32_t*) "%s: could not read page from swap file\n", selfie_name);
+
+    exit(EXITCODE_IOERROR);
+  }
+}
+
+void write_swap_slot(uint32_t slot, uint32_t* frame) {
+  lseek(swap_fd, slot * PAGESIZE, SEEK_SET);
+
+  if (write(swap_fd, frame, PAGESIZE) != PAGESIZE) {
+    printf1((uint32_t*) "%s: could not write page to swap file\n", selfie_name);
+
+    exit(EXITCODE_IOERROR);
+  }
+}
+
+uint32_t page_out() {
+  uint32_t* resident;
+  uint32_t* context;
+  uint32_t  page;
+  uint32_t  frame;
+  uint32_t* swapped;
+  uint32_t  candidates;
+
+  if (swapping == 0)
+    return 0;
+  else if (open_swap_file() == 0)
+    return 0;
+
+  // clock policy: a page cached in the software tlb of its context
+  // counts as referenced and gets a second chance by flushing its
+  // tlb entry, so sweeping twice finds an unreferenced page if any
+
+  candidates = 2 * number_of_resident_pages;
+
+  while (candidates > 0) {
+    if (resident_pages == (uint32_t*) 0)
+      return 0;
+
+    resident = (uint32_t*) *resident_pages;
+
+    context = (uint32_t*) *(resident + 1);
+    page    = *(resident + 2);
+
+    frame = get_frame_for_page(get_pt(context), page);
+
+    if (frame == 0)
+      // page has been unmapped since
+      untrack_next_page();
+    else if (get_hosting(context))
+      // frames of hosting contexts may be mapped by hosted contexts
+      resident_pages = resident;
+    else if (is_frame_shared(frame))
+      // shared frames are mapped by other pages as well
+      resident_pages = resident;
+    else if (is_page_cached(get_software_tlb(context), page)) {
+      flush_tlb_entry(get_software_tlb(context), page);
+
+      resident_pages = resident;
+    } else {
+      swapped = allocate_swapped_page(context, page);
+
+      write_swap_slot(*(swapped + 3), (uint32_t*) frame);
+
+      unmap_page(get_pt(context), page);
+
+      flush_tlb_entry(get_software_tlb(context), page);
+
+      untrack_next_page();
+
+      pfree((uint32_t*) frame);
+
+      page_outs = page_outs + 1;
+
+      return 1;
+    }
+
+    candidates = candidates - 1;
+  }
+
+  return 0;
+}
+
+uint32_t page_in(uint32_t* context, uint32_t page) {
+  uint32_t* bucket;
+  uint32_t* swapped;
+  uint32_t  frame;
+
+  if (number_of_swapped_pages == 0)
+    return 0;
+
+  bucket = swapped_pages + hash_swapped_page(context, page);
+
+  swapped = (uint32_t*) *bucket;
+
+  while (swapped != (uint32_t*) 0) {
+    if (*(swapped + 1) == (uint32_t) context)
+      if (*(swapped + 2) == page) {
+        // remove swapped page from index before
+        // palloc possibly pages out another page
+        *bucket = *swapped;
+
+        number_of_swapped_pages = number_of_swapped_pages - 1;
+
+        frame = (uint32_t) palloc();
+
+        read_swap_slot(*(swapped + 3), (uint32_t*) frame);
+
+        map_page(context, page, frame);
+
+        *swapped = (uint32_t) free_swap_slots;
+
+        free_swap_slots = swapped;
+
+        page_ins = page_ins + 1;
+
+        return 1;
+      }
+
+    bucket  = swapped;
+    swapped = (uint32_t*) *swapped;
+  }
+
+  return 0;
+}
+
+uint32_t load_binary_page(uint32_t* context, uint32_t page) {
+  uint32_t vaddr;
+  uint32_t bytes;
+
+  if (demand_loading == 0)
+    return 0;
+
+  vaddr = page * PAGESIZE;
+
+  // pages with code are always uploaded eagerly
+  if (vaddr < round_up(entry_point + code_length, PAGESIZE))
+    return 0;
+  else if (vaddr >= entry_point + binary_length)
+    return 0;
+  else if (is_page_mapped(get_pt(context), page))
+    return 0;
+
+  bytes = entry_point + binary_length - vaddr;
+
+  if (bytes > PAGESIZE)
+    bytes = PAGESIZE;
+
+  up_load_words(context, vaddr, binary + (vaddr - entry_point) / REGISTERSIZE, bytes);
+
+  return 1;
+}
+
+uint32_t demand_page(uint32_t* context, uint32_t page) {
+  // map page of swap file or binary, if any
+  if (page_in(context, page))
+    return 1;
+  else
+    return load_binary_page(context, page);
+}
+
+void page_in_context(uint32_t* context) {
+  uint32_t* swapped;
+  uint32_t  i;
+
+  i = 0;
+
+  while (number_of_swapped_pages > 0) {
+    if (i == SWAPBUCKETS)
+      return;
+
+    swapped = (uint32_t*) *(swapped_pages + i);
+
+    while (swapped != (uint32_t*) 0)
+      if (*(swapped + 1) == (uint32_t) context) {
+        page_in(context, *(swapped + 2));
+
+        // paging in removes the swapped page from its bucket
+        swapped = (uint32_t*) *(swapped_pages + i);
+      } else
+        swapped = (uint32_t*) *swapped;
+
+    i = i + 1;
+  }
+}
+
+void discard_swapped_pages(uint32_t* context) {
+  uint32_t* bucket;
+  uint32_t* swapped;
+  uint32_t  i;
+
+  i = 0;
+
+  while (number_of_swapped_pages > 0) {
+    if (i == SWAPBUCKETS)
+      return;
+
+    bucket = swapped_pages + i;
+
+    swapped = (uint32_t*) *bucket;
+
+    while (swapped != (uint32_t*) 0) {
+      if (*(swapped + 1) == (uint32_t) context) {
+        *bucket = *swapped;
+
+        number_of_swapped_pages = number_of_swapped_pages - 1;
+
+        *swapped = (uint32_t) free_swap_slots;
+
+        free_swap_slots = swapped;
+      } else
+        bucket = swapped;
+
+      swapped = (uint32_t*) *bucket;
+    }
+
+    i = i + 1;
+  }
+}
+
+void duplicate_swapped_pages(uint32_t* context, uint32_t* child) {
+  uint32_t* swapped;
+  uint32_t  i;
+
+  if (number_of_swapped_pages == 0)
+    return;
+
+  if (swap_buffer == (uint32_t*) 0)
+    swap_buffer = smalloc(PAGESIZE);
+
+  i = 0;
+
+  while (i < SWAPBUCKETS) {
+    swapped = (uint32_t*) *(swapped_pages + i);
+
+    // swapped pages of the child are indexed in front of the bucket
+    while (swapped != (uint32_t*) 0) {
+      if (*(swapped + 1) == (uint32_t) context) {
+        read_swap_slot(*(swapped + 3), swap_buffer);
+
+        write_swap_slot(*(allocate_swapped_page(child, *(swapped + 2)) + 3), swap_buffer);
+      }
+
+      swapped = (uint32_t*) *swapped;
+    }
+
+    i = i + 1;
+  }
+}
+
+void copy_on_write(uint32_t* context, uint32_t page) {
+  uint32_t frame;
+  uint32_t copy;
+  uint32_t i;
+
+  // assert: page is mapped
+
+  frame = get_frame_for_page(get_pt(context), page);
+
+  if (is_frame_shared(frame)) {
+    // shared frames are not paged out by palloc
+    copy = (uint32_t) palloc();
+
+    i = 0;
+
+    while (i < PAGESIZE / REGISTERSIZE) {
+      *((uint32_t*) copy + i) = *((uint32_t*) frame + i);
+
+      i = i + 1;
+    }
+
+    unshare_frame(frame);
+
+    frame = copy;
+  }
+
+  // mapping page again makes it writable
+  map_page(context, page, frame);
+}
+
+void adopt_child(uint32_t* context, uint32_t* child) {
+  set_forker(child, context);
+
+  set_next_sibling(child, get_children(context));
+
+  set_children(context, child);
+}
+
+void reap_context(uint32_t* context) {
+  // assert: context has exited, its page frames are released,
+  // and it is no longer a child of its forker
+
+  if (is_boot_level_zero())
+    used_contexts = delete_context(context, used_contexts);
+  else
+    // hosting boot levels may still cache the context
+    // which must therefore not be reused
+    set_forker(context, (uint32_t*) 0);
+
+  set_next_sibling(context, (uint32_t*) 0);
+}
+
+void retire_context(uint32_t* context) {
+  uint32_t* child;
+  uint32_t* next;
+
+  // page frames of exited contexts are reused
+  release_page_frames(context);
+
+  child = get_children(context);
+
+  set_children(context, (uint32_t*) 0);
+
+  while (child != (uint32_t*) 0) {
+    next = get_next_sibling(child);
+
+    if (get_state(child) == STATE_EXITED)
+      reap_context(child);
+    else {
+      // orphans are never waited for
+      set_forker(child, (uint32_t*) 0);
+
+      set_next_sibling(child, (uint32_t*) 0);
+    }
+
+    child = next;
+  }
+
+  if (get_forker(context) != (uint32_t*) 0)
+    // forker may be waiting for context to exit
+    unblock_context(get_forker(context));
+}
+
+void map_writable_page(uint32_t* context, uint32_t page) {
+  if (is_page_mapped(get_pt(context), page) == 0) {
+    if (page_in(context, page) == 0)
+      map_page(context, page, (uint32_t) palloc());
+  } else if (is_page_read_only(get_pt(context), page))
+    copy_on_write(context, page);
+}
+
+void map_and_store(uint32_t* context, uint32_t vaddr, uint32_t data) {
+  // assert: is_valid_virtual_address(vaddr) == 1
+
+  map_writable_page(context, get_page_of_virtual_address(vaddr));
+
+  if (symbolic) {
+    if (is_trace_space_available())
+      // always track initialized memory by using tc as most recent branch
+      store_symbolic_memory(get_pt(context), vaddr, data, 0, data, data, tc);
+    else {
+      printf1((uint32_t*) "%s: ealloc out of memory\n", selfie_name);
+
+      exit(EXITCODE_OUTOFTRACEMEMORY);
+    }
+  } else
+    store_virtual_memory(get_pt(context), vaddr, data);
+}
+
+void up_load_words(uint32_t* context, uint32_t vaddr, uint32_t* data, uint32_t bytes) {
+  uint32_t* paddr;
+  uint32_t size;
+  uint32_t i;
+
+  // assert: vaddr and bytes are multiples of REGISTERSIZE
+
+  if (symbolic) {
+    // symbolic memory is stored word by word
+    while (bytes > 0) {
+      map_and_store(context, vaddr, *data);
+
+      vaddr = vaddr + REGISTERSIZE;
+      data  = data + 1;
+      bytes = bytes - REGISTERSIZE;
+    }
+
+    return;
+  }
+
+  while (bytes > 0) {
+    map_writable_page(context, get_page_of_virtual_address(vaddr));
+
+    // translate once, then copy up to the end of the page
+    size = PAGESIZE - vaddr % PAGESIZE;
+
+    if (size > bytes)
+      size = bytes;
+
+    paddr = tlb(get_pt(context), vaddr);
+
+    i = 0;
+
+    while (i < size / REGISTERSIZE) {
+      *(paddr + i) = *(data + i);
+
+      i = i + 1;
+    }
+
+    vaddr = vaddr + size;
+    data  = data + size / REGISTERSIZE;
+    bytes = bytes - size;
+  }
+}
+
+void load_code_frames() {
+  uint32_t i;
+  uint32_t frame;
+  uint32_t j;
+
+  if (code_binary == binary)
+    return;
+
+  i = 0;
+
+  // code frames hold one reference for their binary
+  while (i < code_pages) {
+    frame = *(code_frames + i);
+
+    if (unshare_frame(frame) == 0)
+      pfree((uint32_t*) frame);
+
+    i = i + 1;
+  }
+
+  code_binary = binary;
+
+  // the last partial code page is private since it contains data
+  code_pages = code_length / PAGESIZE;
+
+  code_frames = smalloc(code_pages * SIZEOFUINT32);
+
+  i = 0;
+
+  while (i < code_pages) {
+    frame = (uint32_t) palloc();
+
+    j = 0;
+
+    while (j < PAGESIZE / REGISTERSIZE) {
+      *((uint32_t*) frame + j) = load_data(i * PAGESIZE + j * REGISTERSIZE);
 
-    pc = pc + REGISTERSIZE;
+      j = j + 1;
+    }
+
+    *(code_frames + i) = frame;
+
+    i = i + 1;
   }
+}
 
-  disassemble_verbose = 0;
-  disassemble         = 0;
-  debug               = 0;
+void up_load_binary(uint32_t* context) {
+  uint32_t baddr;
+  uint32_t frame;
 
-  output_name = (uint32_t*) 0;
-  output_fd   = 1;
+  // assert: entry_point is multiple of PAGESIZE and REGISTERSIZE
 
-  printf5((uint32_t*) "%s: %d characters of assembly with %d instructions and %d bytes of data written into %s\n", selfie_name,
-    (uint32_t*) number_of_written_characters,
-    (uint32_t*) (code_length / INSTRUCTIONSIZE),
-    (uint32_t*) (binary_length - code_length),
-    assembly_name);
-}
+  set_pc(context, entry_point);
+  set_lo_page(context, get_page_of_virtual_address(entry_point));
+  set_me_page(context, get_page_of_virtual_address(entry_point));
+  set_original_break(context, entry_point + binary_length);
+  set_program_break(context, get_original_break(context));
 
-// -----------------------------------------------------------------
-// ---------------------------- CONTEXTS ---------------------------
-// -----------------------------------------------------------------
+  baddr = 0;
 
-uint32_t* allocate_context(uint32_t* parent, uint32_t* vctxt, uint32_t* in) {
-  uint32_t* context;
+  if (symbolic) {
+    // code is never constrained...
+    symbolic = 0;
 
-  if (free_contexts == (uint32_t*) 0)
-    context = smalloc(7 * SIZEOFUINT32STAR + 9 * SIZEOFUINT32);
-  else {
-    context = free_contexts;
+    up_load_words(context, entry_point, binary, code_length);
 
-    free_contexts = get_next_context(free_contexts);
+    baddr = code_length;
+
+    // ... but data is
+    symbolic = 1;
+  } else {
+    load_code_frames();
+
+    while (baddr < code_pages * PAGESIZE) {
+      frame = *(code_frames + baddr / PAGESIZE);
+
+      // stores into code are copied on write
+      share_frame(frame);
+
+      map_page(context, get_page_of_virtual_address(entry_point + baddr), frame);
+
+      write_protect_page(get_pt(context), get_page_of_virtual_address(entry_point + baddr));
+
+      baddr = baddr + PAGESIZE;
+    }
   }
 
-  set_next_context(context, in);
-  set_prev_context(context, (uint32_t*) 0);
+  if (demand_loading) {
+    if (record)
+      // replaying requires all pages in memory
+      demand_loading = 0;
+    else if (symbolic)
+      // as does symbolic execution
+      demand_loading = 0;
+  }
 
-  if (in != (uint32_t*) 0)
-    set_prev_context(in, context);
+  if (demand_loading) {
+    // only the rest of the last code page is uploaded eagerly,
+    // data pages are loaded by the page fault handler
+    if (round_up(code_length, PAGESIZE) < binary_length)
+      up_load_words(context, entry_point + baddr, binary + baddr / REGISTERSIZE, round_up(code_length, PAGESIZE) - baddr);
+    else
+      up_load_words(context, entry_point + baddr, binary + baddr / REGISTERSIZE, binary_length - baddr);
+  } else
+    up_load_words(context, entry_point + baddr, binary + baddr / REGISTERSIZE, binary_length - baddr);
 
-  set_pc(context, 0);
+  set_name(context, binary_name);
+}
 
-  // allocate zeroed memory for general purpose registers
-  // TODO: reuse memory
-  set_regs(context, zalloc(NUMBEROFREGISTERS * REGISTERSIZE));
+uint32_t up_load_string(uint32_t* context, uint32_t* s, uint32_t SP) {
+  uint32_t bytes;
 
-  // allocate zeroed memory for page table
-  // TODO: save and reuse memory for page table
-  set_pt(context, zalloc(VIRTUALMEMORYSIZE / PAGESIZE * REGISTERSIZE));
+  bytes = round_up(string_length(s) + 1, REGISTERSIZE);
 
-  // determine range of recently mapped pages
-  set_lo_page(context, 0);
-  set_me_page(context, 0);
-  set_hi_page(context, get_page_of_virtual_address(VIRTUALMEMORYSIZE - REGISTERSIZE));
+  // allocate memory for storing string
+  SP = SP - bytes;
 
-  set_exception(context, EXCEPTION_NOEXCEPTION);
-  set_faulting_page(context, 0);
+  up_load_words(context, SP, s, bytes);
 
-  set_exit_code(context, EXITCODE_NOERROR);
+  return SP;
+}
 
-  set_parent(context, parent);
-  set_virtual_context(context, vctxt);
+void up_load_arguments(uint32_t* context, uint32_t argc, uint32_t* argv) {
+  /* upload arguments like a UNIX system
 
-  set_name(context, (uint32_t*) 0);
+      SP
+      |
+      V
+   | argc | argv[0] | ... | argv[n] | 0 | env[0] | ... | env[m] | 0 |
 
-  return context;
+     with argc > 0, n == argc - 1, and m == 0 (that is, env is empty) */
+  uint32_t SP;
+  uint32_t* table;
+  uint32_t i;
+
+  // the call stack grows top down
+  SP = VIRTUALMEMORYSIZE;
+
+  // argc, argv table, and null values terminating argv and env tables
+  table = smalloc((argc + 3) * SIZEOFUINT32);
+
+  *table = argc;
+
+  i = 0;
+
+  // push program parameters onto the stack
+  while (i < argc) {
+    SP = up_load_string(context, (uint32_t*) *(argv + i), SP);
+
+    // store pointer in virtual *argv
+    *(table + 1 + i) = SP;
+
+    i = i + 1;
+  }
+
+  *(table + argc + 1) = 0;
+  *(table + argc + 2) = 0;
+
+  // allocate memory for argc, argv table, and terminations
+  SP = SP - (argc + 3) * REGISTERSIZE;
+
+  // push them all at once
+  up_load_words(context, SP, table, (argc + 3) * REGISTERSIZE);
+
+  // store stack pointer value in stack pointer register
+  *(get_regs(context) + REG_SP) = SP;
+
+  // set bounds to register value for symbolic execution
+  if (symbolic) {
+    *(reg_typ + REG_SP) = 0;
+
+    *(reg_los + REG_SP) = SP;
+    *(reg_ups + REG_SP) = SP;
+  }
 }
 
-uint32_t* find_context(uint32_t* parent, uint32_t* vctxt, uint32_t* in) {
-  uint32_t* context;
+uint32_t snapshot_number(uint32_t* context) {
+  uint32_t number;
 
-  context = in;
+  if (context == MY_CONTEXT)
+    return 0;
+
+  number = 0;
 
+  // used contexts are listed from the most recently created one
   while (context != (uint32_t*) 0) {
-    if (get_parent(context) == parent)
-      if (get_virtual_context(context) == vctxt)
-        return context;
+    number = number + 1;
 
     context = get_next_context(context);
   }
 
-  return (uint32_t*) 0;
+  return number;
 }
 
-void free_context(uint32_t* context) {
-  set_next_context(context, free_contexts);
+uint32_t save_snapshot_frame(uint32_t frame, uint32_t slot) {
+  uint32_t* saved;
 
-  free_contexts = context;
-}
+  // frames mapped by more than one page are saved once
+  if (frame != 0) {
+    saved = (uint32_t*) *(saved_frames + frame / PAGESIZE % SNAPSHOTBUCKETS);
 
-uint32_t* delete_context(uint32_t* context, uint32_t* from) {
-  if (get_next_context(context) != (uint32_t*) 0)
-    set_prev_context(get_next_context(context), get_prev_context(context));
+    while (saved != (uint32_t*) 0) {
+      if (*(saved + 2) == frame)
+        return *(saved + 4);
 
-  if (get_prev_context(context) != (uint32_t*) 0) {
-    set_next_context(get_prev_context(context), get_next_context(context));
-    set_prev_context(context, (uint32_t*) 0);
+      saved = (uint32_t*) *saved;
+    }
+  }
+
+  saved = smalloc(3 * SIZEOFUINT32STAR + 2 * SIZEOFUINT32);
+
+  if (frame != 0) {
+    *saved = *(saved_frames + frame / PAGESIZE % SNAPSHOTBUCKETS);
+
+    *(saved_frames + frame / PAGESIZE % SNAPSHOTBUCKETS) = (uint32_t) saved;
   } else
-    from = get_next_context(context);
+    // swapped out pages are never shared
+    *saved = 0;
 
-  free_context(context);
+  *(saved + 1) = 0;
+  *(saved + 2) = frame;
+  *(saved + 3) = slot;
+  *(saved + 4) = number_of_saved_frames * PAGESIZE;
 
-  return from;
+  if (first_saved_frame == (uint32_t*) 0)
+    first_saved_frame = saved;
+  else
+    *(last_saved_frame + 1) = (uint32_t) saved;
+
+  last_saved_frame = saved;
+
+  number_of_saved_frames = number_of_saved_frames + 1;
+
+  return *(saved + 4);
 }
 
-// -----------------------------------------------------------------
-// -------------------------- MICROKERNEL --------------------------
-// -----------------------------------------------------------------
+uint32_t snapshot_pages(uint32_t* context, uint32_t* entry) {
+  // counts mapped and swapped pages of context and,
+  // unless entry is 0, saves them starting at entry
+  uint32_t* table;
+  uint32_t* leaf;
+  uint32_t* swapped;
+  uint32_t  pages;
+  uint32_t  i;
+  uint32_t  j;
 
-uint32_t* create_context(uint32_t* parent, uint32_t* vctxt) {
-  // TODO: check if context already exists
-  used_contexts = allocate_context(parent, vctxt, used_contexts);
+  table = get_pt(context);
 
-  if (current_context == (uint32_t*) 0)
-    current_context = used_contexts;
+  pages = 0;
 
-  if (debug_create)
-    printf3((uint32_t*) "%s: parent context %p created child context %p\n", selfie_name, parent, used_contexts);
+  i = 0;
 
-  return used_contexts;
-}
+  while (i < VIRTUALMEMORYSIZE / PAGESIZE / LEAFTABLEPAGES) {
+    leaf = (uint32_t*) *(table + i);
 
-uint32_t* cache_context(uint32_t* vctxt) {
-  uint32_t* context;
+    if (leaf != (uint32_t*) 0) {
+      j = 0;
 
-  // find cached context on my boot level
-  context = find_context(current_context, vctxt, used_contexts);
+      while (j < LEAFTABLEPAGES) {
+        if (*(leaf + j) != 0) {
+          if (entry != (uint32_t*) 0) {
+            *entry = i * LEAFTABLEPAGES + j;
 
-  if (context == (uint32_t*) 0)
-    // create cached context on my boot level
-    context = create_context(current_context, vctxt);
+            // keep read-only mark
+            *(entry + 1) = save_snapshot_frame(*(leaf + j) - *(leaf + j) % PAGESIZE, 0) + *(leaf + j) % PAGESIZE;
 
-  return context;
-}
+            entry = entry + 2;
+          }
 
-void save_context(uint32_t* context) {
-  uint32_t* parent_table;
-  uint32_t* vctxt;
-  uint32_t r;
-  uint32_t* registers;
-  uint32_t* vregisters;
+          pages = pages + 1;
+        }
 
-  // save machine state
-  set_pc(context, pc);
+        j = j + 1;
+      }
+    }
 
-  if (get_parent(context) != MY_CONTEXT) {
-    parent_table = get_pt(get_parent(context));
+    i = i + 1;
+  }
 
-    vctxt = get_virtual_context(context);
+  if (number_of_swapped_pages > 0) {
+    i = 0;
 
-    store_virtual_memory(parent_table, program_counter(vctxt), get_pc(context));
+    while (i < SWAPBUCKETS) {
+      swapped = (uint32_t*) *(swapped_pages + i);
 
-    r = 0;
+      while (swapped != (uint32_t*) 0) {
+        if (*(swapped + 1) == (uint32_t) context) {
+          if (entry != (uint32_t*) 0) {
+            *entry       = *(swapped + 2);
+            *(entry + 1) = save_snapshot_frame(0, *(swapped + 3));
 
-    registers = get_regs(context);
+            entry = entry + 2;
+          }
 
-    vregisters = (uint32_t*) load_virtual_memory(parent_table, regs(vctxt));
+          pages = pages + 1;
+        }
 
-    while (r < NUMBEROFREGISTERS) {
-      store_virtual_memory(parent_table, (uint32_t) (vregisters + r), *(registers + r));
+        swapped = (uint32_t*) *swapped;
+      }
 
-      r = r + 1;
+      i = i + 1;
     }
+  }
 
-    store_virtual_memory(parent_table, program_break(vctxt), get_program_break(context));
+  return pages;
+}
+
+void save_snapshot(uint32_t* context) {
+  uint32_t* oldest;
+  uint32_t* record;
+  uint32_t* saved;
+  uint32_t  contexts;
+  uint32_t  pages;
+  uint32_t  words;
+  uint32_t  size;
+  uint32_t* header;
+  uint32_t  page;
+  uint32_t  fd;
+  uint32_t  i;
+
+  if (demand_loading) {
+    // the snapshot does not include the binary
+    oldest = used_contexts;
+
+    while (oldest != (uint32_t*) 0) {
+      if (get_parent(oldest) == MY_CONTEXT) {
+        page = get_page_of_virtual_address(round_up(entry_point + code_length, PAGESIZE));
+
+        while (page * PAGESIZE < entry_point + binary_length) {
+          demand_page(oldest, page);
+
+          page = page + 1;
+        }
+      }
 
-    store_virtual_memory(parent_table, exception(vctxt), get_exception(context));
-    store_virtual_memory(parent_table, faulting_page(vctxt), get_faulting_page(context));
-    store_virtual_memory(parent_table, exit_code(vctxt), get_exit_code(context));
+      oldest = get_next_context(oldest);
+    }
   }
-}
 
-void map_page(uint32_t* context, uint32_t page, uint32_t frame) {
-  uint32_t* table;
+  contexts = 0;
+  pages    = 0;
 
-  table = get_pt(context);
+  record = used_contexts;
 
-  // assert: 0 <= page < VIRTUALMEMORYSIZE / PAGESIZE
+  while (record != (uint32_t*) 0) {
+    contexts = contexts + 1;
 
-  *(table + page) = frame;
+    pages = pages + snapshot_pages(record, (uint32_t*) 0);
 
-  if (page <= get_page_of_virtual_address(get_program_break(context) - REGISTERSIZE)) {
-    // exploit spatial locality in page table caching
-    if (page < get_lo_page(context))
-      set_lo_page(context, page);
-    else if (page > get_me_page(context))
-      set_me_page(context, page);
+    oldest = record;
+
+    record = get_next_context(record);
   }
 
-  if (debug_map) {
-    printf1((uint32_t*) "%s: page ", selfie_name);
-    print_hexadecimal(page, 4);
-    printf2((uint32_t*) " mapped to frame %p in context %p\n", (uint32_t*) frame, context);
+  // binary name including null terminator
+  words = string_length(get_name(context)) / SIZEOFUINT32 + 1;
+
+  size = round_up((SNAPSHOTHEADER + words + contexts * (SNAPSHOTRECORD + NUMBEROFREGISTERS) + 2 * pages + number_of_ready_contexts) * SIZEOFUINT32, PAGESIZE);
+
+  // zeroed memory pads header to page boundary
+  header = zalloc(size);
+
+  *header       = size;
+  *(header + 2) = contexts;
+  *(header + 3) = number_of_ready_contexts;
+  *(header + 4) = snapshot_number(context);
+  *(header + 5) = next_pid;
+  *(header + 6) = entry_point;
+  *(header + 7) = words;
+  *(header + 8) = code_length;
+
+  i = 0;
+
+  while (i < string_length(get_name(context))) {
+    store_character(header + SNAPSHOTHEADER, i, load_character(get_name(context), i));
+
+    i = i + 1;
   }
-}
 
-void restore_context(uint32_t* context) {
-  uint32_t* parent_table;
-  uint32_t* vctxt;
-  uint32_t r;
-  uint32_t* registers;
-  uint32_t* vregisters;
-  uint32_t* table;
-  uint32_t page;
-  uint32_t me;
-  uint32_t frame;
+  saved_frames = zalloc(SNAPSHOTBUCKETS * SIZEOFUINT32STAR);
 
-  if (get_parent(context) != MY_CONTEXT) {
-    parent_table = get_pt(get_parent(context));
+  first_saved_frame = (uint32_t*) 0;
+  last_saved_frame  = (uint32_t*) 0;
 
-    vctxt = get_virtual_context(context);
+  number_of_saved_frames = 0;
 
-    set_pc(context, load_virtual_memory(parent_table, program_counter(vctxt)));
+  record = header + SNAPSHOTHEADER + words;
 
-    r = 0;
+  // parents and forkers are created before their children
+  while (oldest != (uint32_t*) 0) {
+    *record       = get_pid(oldest);
+    *(record + 1) = get_pc(oldest);
+    *(record + 2) = get_original_break(oldest);
+    *(record + 3) = get_program_break(oldest);
+    *(record + 4) = get_exit_code(oldest);
+    *(record + 5) = snapshot_number(get_parent(oldest));
+    *(record + 6) = (uint32_t) get_virtual_context(oldest);
+    *(record + 8) = get_state(oldest);
+    *(record + 9) = snapshot_number(get_forker(oldest));
 
-    registers = get_regs(context);
+    if (get_name(oldest) != (uint32_t*) 0)
+      *(record + 7) = 1;
 
-    vregisters = (uint32_t*) load_virtual_memory(parent_table, regs(vctxt));
+    i = 0;
 
-    while (r < NUMBEROFREGISTERS) {
-      *(registers + r) = load_virtual_memory(parent_table, (uint32_t) (vregisters + r));
+    while (i < NUMBEROFREGISTERS) {
+      *(record + SNAPSHOTRECORD + i) = *(get_regs(oldest) + i);
 
-      r = r + 1;
+      i = i + 1;
     }
 
-    set_program_break(context, load_virtual_memory(parent_table, program_break(vctxt)));
+    *(record + 10) = snapshot_pages(oldest, record + SNAPSHOTRECORD + NUMBEROFREGISTERS);
 
-    set_exception(context, load_virtual_memory(parent_table, exception(vctxt)));
-    set_faulting_page(context, load_virtual_memory(parent_table, faulting_page(vctxt)));
-    set_exit_code(context, load_virtual_memory(parent_table, exit_code(vctxt)));
+    record = record + SNAPSHOTRECORD + NUMBEROFREGISTERS + 2 * *(record + 10);
 
-    table = (uint32_t*) load_virtual_memory(parent_table, page_table(vctxt));
+    oldest = get_prev_context(oldest);
+  }
 
-    // assert: context page table is only mapped from beginning up and end down
+  saved = ready_contexts;
 
-    page = load_virtual_memory(parent_table, lo_page(vctxt));
-    me   = load_virtual_memory(parent_table, me_page(vctxt));
+  while (saved != (uint32_t*) 0) {
+    *record = snapshot_number(saved);
 
-    while (page <= me) {
-      if (is_virtual_address_mapped(parent_table, frame_for_page(table, page))) {
-        frame = load_virtual_memory(parent_table, frame_for_page(table, page));
+    record = record + 1;
 
-        map_page(context, page, get_frame_for_page(parent_table, get_page_of_virtual_address(frame)));
-      }
+    saved = get_next_ready(saved);
+  }
 
-      page = page + 1;
-    }
+  *(header + 1) = number_of_saved_frames;
+
+  fd = open_write_only(save_snapshot_name);
+
+  if (signed_less_than(fd, 0)) {
+    printf2((uint32_t*) "%s: could not create snapshot file %s\n", selfie_name, save_snapshot_name);
+
+    exit(EXITCODE_IOERROR);
+  }
+
+  if (write(fd, header, size) != size) {
+    printf2((uint32_t*) "%s: could not write header of snapshot file %s\n", selfie_name, save_snapshot_name);
+
+    exit(EXITCODE_IOERROR);
+  }
 
-    store_virtual_memory(parent_table, lo_page(vctxt), page);
+  if (swap_buffer == (uint32_t*) 0)
+    swap_buffer = smalloc(PAGESIZE);
 
-    page = load_virtual_memory(parent_table, hi_page(vctxt));
+  saved = first_saved_frame;
 
-    if (is_virtual_address_mapped(parent_table, frame_for_page(table, page)))
-      frame = load_virtual_memory(parent_table, frame_for_page(table, page));
-    else
-      frame = 0;
+  while (saved != (uint32_t*) 0) {
+    if (*(saved + 2) == 0) {
+      read_swap_slot(*(saved + 3), swap_buffer);
 
-    while (frame != 0) {
-      map_page(context, page, get_frame_for_page(parent_table, get_page_of_virtual_address(frame)));
+      i = write(fd, swap_buffer, PAGESIZE);
+    } else
+      i = write(fd, (uint32_t*) *(saved + 2), PAGESIZE);
 
-      page  = page - 1;
+    if (i != PAGESIZE) {
+      printf2((uint32_t*) "%s: could not write page frame into snapshot file %s\n", selfie_name, save_snapshot_name);
 
-      if (is_virtual_address_mapped(parent_table, frame_for_page(table, page)))
-        frame = load_virtual_memory(parent_table, frame_for_page(table, page));
-      else
-        frame = 0;
+      exit(EXITCODE_IOERROR);
     }
 
-    store_virtual_memory(parent_table, hi_page(vctxt), page);
+    saved = (uint32_t*) *(saved + 1);
   }
-}
-
-// -----------------------------------------------------------------
-// ---------------------------- KERNEL -----------------------------
-// -----------------------------------------------------------------
 
-uint32_t pavailable() {
-  if (free_page_frame_memory > 0)
-    return 1;
-  else if (allocated_page_frame_memory + MEGABYTE <= page_frame_memory)
-    return 1;
-  else
-    return 0;
+  printf4((uint32_t*) "%s: %d contexts with %d page frames saved into snapshot %s\n", selfie_name,
+    (uint32_t*) contexts,
+    (uint32_t*) number_of_saved_frames,
+    save_snapshot_name);
 }
 
-uint32_t pexcess() {
-  if (pavailable())
-    return 1;
-  else if (allocated_page_frame_memory + MEGABYTE <= 2 * page_frame_memory)
-    // tolerate twice as much memory mapped on demand than physically available
-    return 1;
-  else
-    return 0;
-}
+uint32_t* restore_snapshot() {
+  uint32_t  fd;
+  uint32_t  size;
+  uint32_t* header;
+  uint32_t  frames;
+  uint32_t* frame;
+  uint32_t  memory;
+  uint32_t* contexts;
+  uint32_t* references;
+  uint32_t* record;
+  uint32_t* context;
+  uint32_t* parent;
+  uint32_t  state;
+  uint32_t  pages;
+  uint32_t  offset;
+  uint32_t  i;
 
-uint32_t pused() {
-  return allocated_page_frame_memory - free_page_frame_memory;
-}
+  fd = open(restore_snapshot_name, O_RDONLY, 0);
 
-uint32_t* palloc() {
-  uint32_t block;
-  uint32_t frame;
+  if (signed_less_than(fd, 0)) {
+    printf2((uint32_t*) "%s: could not open snapshot file %s\n", selfie_name, restore_snapshot_name);
 
-  // assert: page_frame_memory is equal to or a multiple of MEGABYTE
-  // assert: PAGESIZE is a factor of MEGABYTE strictly less than MEGABYTE
+    exit(EXITCODE_IOERROR);
+  }
 
-  if (free_page_frame_memory == 0) {
-    if (pexcess()) {
-      free_page_frame_memory = MEGABYTE;
+  size = 0;
 
-      // on boot level zero allocate zeroed memory
-      block = (uint32_t) zalloc(free_page_frame_memory);
+  // header size comes first
+  if (read(fd, binary_buffer, SIZEOFUINT32) == SIZEOFUINT32)
+    size = *binary_buffer;
 
-      allocated_page_frame_memory = allocated_page_frame_memory + free_page_frame_memory;
+  header = (uint32_t*) 0;
 
-      // page frames must be page-aligned to work as page table index
-      next_page_frame = round_up(block, PAGESIZE);
+  if (size > 0)
+    if (size % PAGESIZE == 0) {
+      // make sure header is mapped for reading into it
+      header = touch(smalloc(size), size);
 
-      if (next_page_frame > block)
-        // losing one page frame to fragmentation
-        free_page_frame_memory = free_page_frame_memory - PAGESIZE;
-    } else {
-      print(selfie_name);
-      print((uint32_t*) ": palloc out of physical memory\n");
+      *header = size;
 
-      exit(EXITCODE_OUTOFPHYSICALMEMORY);
+      // files are read sequentially since seeking
+      // only works through the host on boot level zero
+      if (read(fd, header + 1, size - SIZEOFUINT32) != size - SIZEOFUINT32)
+        header = (uint32_t*) 0;
     }
-  }
 
-  frame = next_page_frame;
+  if (header == (uint32_t*) 0) {
+    printf2((uint32_t*) "%s: failed to read header of snapshot file %s\n", selfie_name, restore_snapshot_name);
 
-  next_page_frame = next_page_frame + PAGESIZE;
+    exit(EXITCODE_IOERROR);
+  }
 
-  free_page_frame_memory = free_page_frame_memory - PAGESIZE;
+  frames = *(header + 1);
 
-  // strictly, touching is only necessary on boot levels higher than zero
-  return touch((uint32_t*) frame, PAGESIZE);
-}
+  frame = smalloc(frames * SIZEOFUINT32STAR);
 
-void pfree(uint32_t* frame) {
-  // TODO: implement free list of page frames
-  frame = frame + 1;
-}
+  // map the whole snapshot file privately so that the host
+  // loads page frames lazily on first access and copies them
+  // on first write, leaving the snapshot file unmodified
+  memory = (uint32_t) mmap((uint32_t*) 0, size + frames * PAGESIZE, PROT_READ_WRITE, MAP_PRIVATE, fd, 0);
 
-void map_and_store(uint32_t* context, uint32_t vaddr, uint32_t data) {
-  // assert: is_valid_virtual_address(vaddr) == 1
+  if (memory != MAP_FAILED) {
+    allocated_page_frame_memory = allocated_page_frame_memory + frames * PAGESIZE;
 
-  if (is_virtual_address_mapped(get_pt(context), vaddr) == 0)
-    map_page(context, get_page_of_virtual_address(vaddr), (uint32_t) palloc());
+    i = 0;
 
-  if (symbolic) {
-    if (is_trace_space_available())
-      // always track initialized memory by using tc as most recent branch
-      store_symbolic_memory(get_pt(context), vaddr, data, 0, data, data, tc);
-    else {
-      printf1((uint32_t*) "%s: ealloc out of memory\n", selfie_name);
+    while (i < frames) {
+      *(frame + i) = memory + size + i * PAGESIZE;
 
-      exit(EXITCODE_OUTOFTRACEMEMORY);
+      i = i + 1;
     }
-  } else
-    store_virtual_memory(get_pt(context), vaddr, data);
-}
-
-void up_load_binary(uint32_t* context) {
-  uint32_t baddr;
-
-  // assert: entry_point is multiple of PAGESIZE and REGISTERSIZE
-
-  set_pc(context, entry_point);
-  set_lo_page(context, get_page_of_virtual_address(entry_point));
-  set_me_page(context, get_page_of_virtual_address(entry_point));
-  set_original_break(context, entry_point + binary_length);
-  set_program_break(context, get_original_break(context));
+  } else {
+    // without mmap, page frames are read eagerly
+    i = 0;
 
-  baddr = 0;
+    while (i < frames) {
+      *(frame + i) = (uint32_t) palloc();
 
-  if (symbolic) {
-    // code is never constrained...
-    symbolic = 0;
+      if (read(fd, (uint32_t*) *(frame + i), PAGESIZE) != PAGESIZE) {
+        printf2((uint32_t*) "%s: failed to read page frame from snapshot file %s\n", selfie_name, restore_snapshot_name);
 
-    while (baddr < code_length) {
-      map_and_store(context, entry_point + baddr, load_data(baddr));
+        exit(EXITCODE_IOERROR);
+      }
 
-      baddr = baddr + REGISTERSIZE;
+      i = i + 1;
     }
-
-    // ... but data is
-    symbolic = 1;
   }
 
-  while (baddr < binary_length) {
-    map_and_store(context, entry_point + baddr, load_data(baddr));
+  if (pused() > peak_page_frame_memory)
+    peak_page_frame_memory = pused();
 
-    baddr = baddr + REGISTERSIZE;
-  }
+  contexts = smalloc(*(header + 2) * SIZEOFUINT32STAR);
 
-  set_name(context, binary_name);
-}
+  // number of pages of my contexts mapped to each frame
+  references = zalloc(frames * SIZEOFUINT32);
 
-uint32_t up_load_string(uint32_t* context, uint32_t* s, uint32_t SP) {
-  uint32_t bytes;
-  uint32_t i;
+  record = header + SNAPSHOTHEADER + *(header + 7);
 
-  bytes = round_up(string_length(s) + 1, REGISTERSIZE);
+  i = 0;
 
-  // allocate memory for storing string
-  SP = SP - bytes;
+  while (i < *(header + 2)) {
+    if (*(record + 5) == 0)
+      parent = MY_CONTEXT;
+    else
+      parent = (uint32_t*) *(contexts + *(record + 5) - 1);
 
-  i = 0;
+    context = create_context(parent, (uint32_t*) *(record + 6));
 
-  while (i < bytes) {
-    map_and_store(context, SP + i, *s);
+    *(contexts + i) = (uint32_t) context;
 
-    s = s + 1;
+    set_pid(context, *record);
+    set_pc(context, *(record + 1));
+    set_original_break(context, *(record + 2));
+    set_program_break(context, *(record + 3));
+    set_exit_code(context, *(record + 4));
 
-    i = i + REGISTERSIZE;
-  }
+    if (*(record + 7))
+      set_name(context, header + SNAPSHOTHEADER);
 
-  return SP;
-}
+    if (*(record + 9) != 0)
+      adopt_child((uint32_t*) *(contexts + *(record + 9) - 1), context);
 
-void up_load_arguments(uint32_t* context, uint32_t argc, uint32_t* argv) {
-  /* upload arguments like a UNIX system
+    state = *(record + 8);
+    pages = *(record + 10);
 
-      SP
-      |
-      V
-   | argc | argv[0] | ... | argv[n] | 0 | env[0] | ... | env[m] | 0 |
+    record = record + SNAPSHOTRECORD;
 
-     with argc > 0, n == argc - 1, and m == 0 (that is, env is empty) */
-  uint32_t SP;
-  uint32_t* vargv;
-  uint32_t i;
+    offset = 0;
 
-  // the call stack grows top down
-  SP = VIRTUALMEMORYSIZE;
+    while (offset < NUMBEROFREGISTERS) {
+      *(get_regs(context) + offset) = *(record + offset);
 
-  vargv = smalloc(argc * SIZEOFUINT32STAR);
+      offset = offset + 1;
+    }
 
-  i = 0;
+    record = record + NUMBEROFREGISTERS;
 
-  // push program parameters onto the stack
-  while (i < argc) {
-    SP = up_load_string(context, (uint32_t*) *(argv + i), SP);
+    while (pages > 0) {
+      offset = *(record + 1);
 
-    // store pointer in virtual *argv
-    *(vargv + i) = SP;
+      map_page(context, *record, *(frame + offset / PAGESIZE));
 
-    i = i + 1;
-  }
+      if (offset % PAGESIZE == READONLY)
+        write_protect_page(get_pt(context), *record);
 
-  // allocate memory for termination of env table
-  SP = SP - REGISTERSIZE;
+      if (parent == MY_CONTEXT) {
+        if (*(references + offset / PAGESIZE) > 0)
+          share_frame(*(frame + offset / PAGESIZE));
+
+        *(references + offset / PAGESIZE) = *(references + offset / PAGESIZE) + 1;
+      }
 
-  // push null value to terminate env table
-  map_and_store(context, SP, 0);
+      record = record + 2;
 
-  // allocate memory for termination of argv table
-  SP = SP - REGISTERSIZE;
+      pages = pages - 1;
+    }
 
-  // push null value to terminate argv table
-  map_and_store(context, SP, 0);
+    if (state == STATE_BLOCKED)
+      block_context(context);
+    else if (state == STATE_EXITED)
+      set_state(context, STATE_EXITED);
 
-  // assert: i == argc
+    i = i + 1;
+  }
 
-  // push argv table onto the stack
-  while (i > 0) {
-    // allocate memory for argv table entry
-    SP = SP - REGISTERSIZE;
+  i = 0;
 
-    i = i - 1;
+  while (i < *(header + 3)) {
+    make_ready((uint32_t*) *(contexts + *(record + i) - 1));
 
-    // push argv table entry
-    map_and_store(context, SP, *(vargv + i));
+    i = i + 1;
   }
 
-  // allocate memory for argc
-  SP = SP - REGISTERSIZE;
+  next_pid = *(header + 5);
 
-  // push argc
-  map_and_store(context, SP, argc);
+  // profiling counts per instruction relative to entry point
+  entry_point = *(header + 6);
 
-  // store stack pointer value in stack pointer register
-  *(get_regs(context) + REG_SP) = SP;
+  // decoded instruction caches cover the code segment
+  code_length = *(header + 8);
 
-  // set bounds to register value for symbolic execution
-  if (symbolic) {
-    *(reg_typ + REG_SP) = 0;
+  binary_name = header + SNAPSHOTHEADER;
 
-    *(reg_los + REG_SP) = SP;
-    *(reg_ups + REG_SP) = SP;
-  }
+  // data pages not yet loaded are part of the snapshot
+  demand_loading = 0;
+
+  printf4((uint32_t*) "%s: %d contexts with %d page frames restored from snapshot %s\n", selfie_name,
+    (uint32_t*) *(header + 2),
+    (uint32_t*) frames,
+    restore_snapshot_name);
+
+  // the running context was saved right before reading its input
+  // and reads the input of the restored machine when continuing
+  return (uint32_t*) *(contexts + *(header + 4) - 1);
 }
 
 uint32_t handle_system_call(uint32_t* context) {
@@ -9248,6 +13540,10 @@ uint32_t handle_system_call(uint32_t* context) {
     implement_write(context);
   else if (a7 == SYSCALL_OPENAT)
     implement_openat(context);
+  else if (a7 == SYSCALL_FORK)
+    implement_fork(context);
+  else if (a7 == SYSCALL_WAIT)
+    implement_wait(context);
   else if (a7 == SYSCALL_EXIT) {
     implement_exit(context);
 
@@ -9270,11 +13566,85 @@ uint32_t handle_system_call(uint32_t* context) {
     return DONOTEXIT;
 }
 
+uint32_t forwards_unchanged(uint32_t* context) {
+  // every hosting boot level needs to have opted in
+  while (get_parent(context) != MY_CONTEXT) {
+    if (load_virtual_memory(get_pt(get_parent(context)), paravirtual(get_virtual_context(context))) == 0)
+      return 0;
+
+    context = get_parent(context);
+  }
+
+  return 1;
+}
+
+uint32_t handle_paravirtual_call(uint32_t* context) {
+  uint32_t a7;
+  uint32_t vbuffer;
+  uint32_t size;
+  uint32_t page;
+
+  if (paravirtual_calls == 0)
+    return 0;
+  else if (get_exception(context) != EXCEPTION_SYSCALL)
+    return 0;
+
+  a7 = *(get_regs(context) + REG_A7);
+
+  if (a7 != SYSCALL_READ)
+    if (a7 != SYSCALL_WRITE)
+      return 0;
+
+  if (forwards_unchanged(context) == 0)
+    return 0;
+
+  vbuffer = *(get_regs(context) + REG_A1);
+  size    = *(get_regs(context) + REG_A2);
+
+  if (size > 0) {
+    if (vbuffer + size - 1 < vbuffer)
+      return 0;
+    else if (vbuffer + size - 1 >= VIRTUALMEMORYSIZE)
+      return 0;
+
+    page = get_page_of_virtual_address(vbuffer);
+
+    // hosting boot levels map pages on demand and copy on write
+    while (page <= get_page_of_virtual_address(vbuffer + size - 1)) {
+      if (is_page_mapped(get_pt(context), page) == 0)
+        return 0;
+      else if (a7 == SYSCALL_READ)
+        if (is_page_read_only(get_pt(context), page))
+          return 0;
+
+      page = page + 1;
+    }
+  }
+
+  handle_system_call(context);
+
+  // save_context saves the machine state of pc
+  pc = get_pc(context);
+
+  // the context continues as if the hosting boot levels handled the call
+  save_context(context);
+
+  return 1;
+}
+
 uint32_t handle_page_fault(uint32_t* context) {
   set_exception(context, EXCEPTION_NOEXCEPTION);
 
-  // TODO: use this table to unmap and reuse frames
-  map_page(context, get_faulting_page(context), (uint32_t) palloc());
+  if (demand_page(context, get_faulting_page(context)) == 0)
+    map_page(context, get_faulting_page(context), (uint32_t) palloc());
+
+  return DONOTEXIT;
+}
+
+uint32_t handle_write_fault(uint32_t* context) {
+  set_exception(context, EXCEPTION_NOEXCEPTION);
+
+  copy_on_write(context, get_faulting_page(context));
 
   return DONOTEXIT;
 }
@@ -9320,6 +13690,8 @@ uint32_t handle_exception(uint32_t* context) {
     return handle_system_call(context);
   else if (exception == EXCEPTION_PAGEFAULT)
     return handle_page_fault(context);
+  else if (exception == EXCEPTION_WRITEFAULT)
+    return handle_write_fault(context);
   else if (exception == EXCEPTION_DIVISIONBYZERO)
     return handle_division_by_zero(context);
   else if (exception == EXCEPTION_MAXTRACE)
@@ -9341,25 +13713,38 @@ uint32_t mipster(uint32_t* to_context) {
   uint32_t timeout;
   uint32_t* from_context;
 
-  print((uint32_t*) "mipster\n");
+  if (jit)
+    print((uint32_t*) "jipster\n");
+  else
+    print((uint32_t*) "mipster\n");
 
-  timeout = TIMESLICE;
+  timeout = time_slice();
 
   while (1) {
     from_context = mipster_switch(to_context, timeout);
 
     if (get_parent(from_context) != MY_CONTEXT) {
-      // switch to parent which is in charge of handling exceptions
-      to_context = get_parent(from_context);
+      if (handle_paravirtual_call(from_context)) {
+        // continue for the rest of the time slice
+        to_context = from_context;
 
-      timeout = TIMEROFF;
-    } else if (handle_exception(from_context) == EXIT)
-      return get_exit_code(from_context);
-    else {
-      // TODO: scheduler should go here
-      to_context = from_context;
+        timeout = timer;
+      } else {
+        // switch to parent which is in charge of handling exceptions
+        to_context = get_parent(from_context);
+
+        timeout = TIMEROFF;
+      }
+    } else {
+      if (handle_exception(from_context) == EXIT)
+        set_state(from_context, STATE_EXITED);
+
+      to_context = schedule(from_context);
+
+      if (to_context == (uint32_t*) 0)
+        return get_exit_code(from_context);
 
-      timeout = TIMESLICE;
+      timeout = time_slice();
     }
   }
 }
@@ -9370,13 +13755,15 @@ uint32_t hypster(uint32_t* to_context) {
   print((uint32_t*) "hypster\n");
 
   while (1) {
-    from_context = hypster_switch(to_context, TIMESLICE);
+    from_context = hypster_switch(to_context, time_slice());
 
     if (handle_exception(from_context) == EXIT)
+      set_state(from_context, STATE_EXITED);
+
+    to_context = schedule(from_context);
+
+    if (to_context == (uint32_t*) 0)
       return get_exit_code(from_context);
-    else
-      // TODO: scheduler should go here
-      to_context = from_context;
   }
 }
 
@@ -9388,7 +13775,7 @@ uint32_t mixter(uint32_t* to_context, uint32_t mix) {
 
   printf2((uint32_t*) "mixter (%d%% mipster/%d%% hypster)\n", (uint32_t*) mix, (uint32_t*) (100 - mix));
 
-  mslice = TIMESLICE;
+  mslice = timeslice;
 
   if (mslice <= UINT32_MAX / 100)
     mslice = mslice * mix / 100;
@@ -9404,7 +13791,7 @@ uint32_t mixter(uint32_t* to_context, uint32_t mix) {
   } else {
     mix = 0;
 
-    timeout = TIMESLICE;
+    timeout = timeslice;
   }
 
   while (1) {
@@ -9418,17 +13805,20 @@ uint32_t mixter(uint32_t* to_context, uint32_t mix) {
       to_context = get_parent(from_context);
 
       timeout = TIMEROFF;
-    } else if (handle_exception(from_context) == EXIT)
-      return get_exit_code(from_context);
-    else {
-      // TODO: scheduler should go here
-      to_context = from_context;
+    } else {
+      if (handle_exception(from_context) == EXIT)
+        set_state(from_context, STATE_EXITED);
+
+      to_context = schedule(from_context);
+
+      if (to_context == (uint32_t*) 0)
+        return get_exit_code(from_context);
 
       if (mix) {
-        if (mslice != TIMESLICE) {
+        if (mslice != timeslice) {
           mix = 0;
 
-          timeout = TIMESLICE - mslice;
+          timeout = timeslice - mslice;
         }
       } else if (mslice > 0) {
         mix = 1;
@@ -9443,7 +13833,7 @@ uint32_t minmob(uint32_t* to_context) {
   uint32_t timeout;
   uint32_t* from_context;
 
-  timeout = TIMESLICE;
+  timeout = time_slice();
 
   while (1) {
     from_context = mipster_switch(to_context, timeout);
@@ -9462,12 +13852,14 @@ uint32_t minmob(uint32_t* to_context) {
 
         return EXITCODE_UNCAUGHTEXCEPTION;
       } else if (handle_exception(from_context) == EXIT)
-        return get_exit_code(from_context);
+        set_state(from_context, STATE_EXITED);
 
-      // TODO: scheduler should go here
-      to_context = from_context;
+      to_context = schedule(from_context);
 
-      timeout = TIMESLICE;
+      if (to_context == (uint32_t*) 0)
+        return get_exit_code(from_context);
+
+      timeout = time_slice();
     }
   }
 }
@@ -9550,7 +13942,7 @@ uint32_t monster(uint32_t* to_context) {
 
   b = 0;
 
-  timeout = TIMESLICE;
+  timeout = timeslice;
 
   while (1) {
     from_context = mipster_switch(to_context, timeout);
@@ -9583,7 +13975,7 @@ uint32_t monster(uint32_t* to_context) {
       // TODO: scheduler should go here
       to_context = from_context;
 
-      timeout = TIMESLICE;
+      timeout = timeslice;
     }
   }
 }
@@ -9611,8 +14003,14 @@ uint32_t is_boot_level_zero() {
 uint32_t selfie_run(uint32_t machine) {
   uint32_t exit_code;
 
-  if (binary_length == 0) {
-    printf1((uint32_t*) "%s: nothing to run, debug, or host\n", selfie_name);
+  if (restore_snapshot_name == (uint32_t*) 0) {
+    if (binary_length == 0) {
+      printf1((uint32_t*) "%s: nothing to run, debug, or host\n", selfie_name);
+
+      return EXITCODE_BADARGUMENTS;
+    }
+  } else if (machine == MONSTER) {
+    printf1((uint32_t*) "%s: snapshots do not include symbolic state\n", selfie_name);
 
     return EXITCODE_BADARGUMENTS;
   }
@@ -9630,7 +14028,8 @@ uint32_t selfie_run(uint32_t machine) {
     symbolic = 1;
 
     init_symbolic_engine();
-  }
+  } else if (machine == JIPSTER)
+    jit = 1;
 
   if (machine == MONSTER) {
     init_memory(round_up(MAX_TRACE_LENGTH * SIZEOFUINT32, MEGABYTE) / MEGABYTE + 1);
@@ -9641,17 +14040,40 @@ uint32_t selfie_run(uint32_t machine) {
 
   execute = 1;
 
+  // replaying and symbolic execution require all pages in memory,
+  // and only the host provides seekable files for swapping
+  if (record)
+    swapping = 0;
+  else if (symbolic)
+    swapping = 0;
+  else
+    swapping = is_boot_level_zero();
+
+  // snapshots do not include symbolic state
+  if (symbolic)
+    save_snapshot_name = (uint32_t*) 0;
+
+  // forwarding calls unchanged skips debugging output and snapshots
+  if (debug)
+    paravirtual_calls = 0;
+  else if (save_snapshot_name != (uint32_t*) 0)
+    paravirtual_calls = 0;
+
   reset_interpreter();
   reset_microkernel();
 
-  create_context(MY_CONTEXT, 0);
+  if (restore_snapshot_name == (uint32_t*) 0) {
+    create_context(MY_CONTEXT, 0);
 
-  up_load_binary(current_context);
+    up_load_binary(current_context);
 
-  // pass binary name as first argument by replacing memory size
-  set_argument(binary_name);
+    // pass binary name as first argument by replacing memory size
+    set_argument(binary_name);
 
-  up_load_arguments(current_context, number_of_remaining_arguments(), remaining_arguments());
+    up_load_arguments(current_context, number_of_remaining_arguments(), remaining_arguments());
+  } else
+    // arguments are part of the restored machine
+    current_context = restore_snapshot();
 
   printf3((uint32_t*) "%s: selfie executing %s with %dMB physical memory on ", selfie_name, binary_name, (uint32_t*) (page_frame_memory / MEGABYTE));
 
@@ -9661,6 +14083,8 @@ uint32_t selfie_run(uint32_t machine) {
     exit_code = mipster(current_context);
   else if (machine == RIPSTER)
     exit_code = mipster(current_context);
+  else if (machine == JIPSTER)
+    exit_code = mipster(current_context);
   else if (machine == MONSTER)
     exit_code = monster(current_context);
   else if (machine == MINSTER)
@@ -9683,11 +14107,22 @@ uint32_t selfie_run(uint32_t machine) {
 
   print_profile();
 
+  if (save_snapshot_name != (uint32_t*) 0) {
+    // snapshots are only saved right before reading input
+    printf1((uint32_t*) "%s: no snapshot saved: no input was read\n", selfie_name);
+
+    save_snapshot_name = (uint32_t*) 0;
+
+    exit_code = EXITCODE_IOERROR;
+  }
+
   symbolic    = 0;
   record      = 0;
   disassemble = 0;
   debug       = 0;
 
+  jit = 0;
+
   fuzz = 0;
 
   return exit_code;
@@ -10051,10 +14486,12 @@ void set_argument(uint32_t* argv) {
 }
 
 void print_usage() {
-  printf3((uint32_t*) "%s: usage: selfie { %s } [ %s ]\n",
+  printf5((uint32_t*) "%s: usage: selfie { %s | %s } [ %s ] [ %s ]\n",
     selfie_name,
-      (uint32_t*) "-c { source } | -o binary | [ -s | -S ] assembly | -l binary | -sat dimacs",
-      (uint32_t*) "( -m | -d | -r | -n | -y | -min | -mob ) 0-32 ...");
+      (uint32_t*) "-c { source } | -o binary | [ -s | -S ] assembly | -t translation | -l binary | -sat dimacs",
+      (uint32_t*) "-p 0-2 | -ts slice | -dl 0-1 | -pv 0-1",
+      (uint32_t*) "-save snapshot | -restore snapshot | -swap file",
+      (uint32_t*) "( -m | -d | -r | -j | -n | -y | -min | -mob ) 0-32 ...");
 }
 
 uint32_t selfie() {
@@ -10084,16 +14521,47 @@ uint32_t selfie() {
         selfie_disassemble(0);
       else if (string_compare(option, (uint32_t*) "-S"))
         selfie_disassemble(1);
+      else if (string_compare(option, (uint32_t*) "-t"))
+        selfie_translate();
       else if (string_compare(option, (uint32_t*) "-l"))
         selfie_load();
       else if (string_compare(option, (uint32_t*) "-sat"))
         selfie_sat();
+      else if (string_compare(option, (uint32_t*) "-p")) {
+        profiling = atoi(get_argument());
+
+        if (profiling > PROFILE_FULL) {
+          print_usage();
+
+          return EXITCODE_BADARGUMENTS;
+        }
+      } else if (string_compare(option, (uint32_t*) "-dl"))
+        demand_loading = atoi(get_argument());
+      else if (string_compare(option, (uint32_t*) "-pv"))
+        paravirtual_calls = atoi(get_argument());
+      else if (string_compare(option, (uint32_t*) "-save"))
+        save_snapshot_name = get_argument();
+      else if (string_compare(option, (uint32_t*) "-restore"))
+        restore_snapshot_name = get_argument();
+      else if (string_compare(option, (uint32_t*) "-swap"))
+        swap_file_name = get_argument();
+      else if (string_compare(option, (uint32_t*) "-ts")) {
+        timeslice = atoi(get_argument());
+
+        if (timeslice == 0) {
+          print_usage();
+
+          return EXITCODE_BADARGUMENTS;
+        }
+      }
       else if (string_compare(option, (uint32_t*) "-m"))
         return selfie_run(MIPSTER);
       else if (string_compare(option, (uint32_t*) "-d"))
         return selfie_run(DIPSTER);
       else if (string_compare(option, (uint32_t*) "-r"))
         return selfie_run(RIPSTER);
+      else if (string_compare(option, (uint32_t*) "-j"))
+        return selfie_run(JIPSTER);
       else if (string_compare(option, (uint32_t*) "-n"))
         return selfie_run(MONSTER);
       else if (string_compare(option, (uint32_t*) "-y"))